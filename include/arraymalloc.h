@@ -1,2 +1,14 @@
+/*
+ *  Alignment parameters for arraymalloc2daligned (bytes)
+ */
+
+#define ARRAYLINE       64        // cache line
+#define ARRAYCRITICAL   4096      // stride at which rows alias in cache
+#define ARRAYHUGEPAGE   2097152   // transparent huge page
+
 void  **arraymalloc2d(int nx, int ny,         size_t typesize);
 void ***arraymalloc3d(int nx, int ny, int nz, size_t typesize);
+
+void  **arraymalloc2daligned(int nx, int ny, size_t typesize,
+                             size_t align, int pitch, int hugepage);
+int     arraypitch(int ny, size_t typesize);
@@ -3,11 +3,32 @@
  */
 
 /*
- *  System size L
+ *  System size L: LDEFAULT, or chosen at run time by -tile so that
+ *  every process has the same number of cells whatever their number
  */
 #include <math.h>
 
-#define L 960 // Change L here
+#define LDEFAULT 960 // Change L here
+
+int L; // The size of the global grid
+
+/*
+ *  Memory layout of the local arrays: alignment in bytes (64 for a
+ *  cache line, 4096 for a page), row pitch in elements (0 pads rows
+ *  automatically) and transparent huge pages (1 on, 0 off)
+ */
+
+#define ALIGN    64 // Change alignment here
+#define PITCH    0  // Change row pitch here
+#define HUGEPAGE 0  // Change huge pages here
+
+/*
+ *  The update rule: bit n is set if a cell whose sum of itself and
+ *  its four nearest neighbours is n is alive on the next step (2, 4
+ *  and 5). Recorded in checkpoints; the update loops hard-code it.
+ */
+
+#define RULE 0x34
 
 /*
  *  Use 1D decomposition over NPROC processes across first dimension
@@ -31,6 +52,8 @@ int *LYY; // Array of LY of every block
 
 void autowrite(char *cellfile, int cell[L][L]);
 void autowritedynamic(char *cellfile, int **cell, int l);
+void autowriterect(char *cellfile, int **cell, int nx, int ny);
+void autowritepgm(char *greyfile, int **grey, int nx, int ny);
 
 /*
  *  Calculate and set LX, LY for every process
@@ -0,0 +1,19 @@
+/*
+ *  Start from an existing pattern instead of random cells
+ */
+
+#ifndef AUTOREAD_H
+#define AUTOREAD_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+#define READ_P1  1 // ASCII PBM, as written by autowritedynamic
+#define READ_P4  4 // binary PBM, eight pixels per byte
+#define READ_RAW 0 // L x L bytes, cell (i, j) at i*L + j, non-zero alive
+
+int autosize(const char *filename, MPI_Comm comm);
+int autoread(const char *filename, grid *g, MPI_Comm comm);
+
+#endif // AUTOREAD_H
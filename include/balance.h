@@ -0,0 +1,48 @@
+/*
+ *  Dynamic load balancing of the process grid.
+ *
+ *  Every freq steps the time each process spent updating its cells
+ *  (g->tstep) is gathered. Assuming every process keeps updating
+ *  cells at the rate it did, the row split points LXX are moved so
+ *  that the slowest process of each process row takes the same time,
+ *  then the column split points LYY likewise. If the time saved over
+ *  the next freq steps is predicted to be more than the time taken to
+ *  move the cells that change owner, they are sent point to point to
+ *  their new process and the local grid is rebuilt.
+ *
+ *  A migration is predicted to take a fixed time to rebuild the grid,
+ *  measured by rebuilding it once at the start, plus a time per cell
+ *  received, first estimated from timed halo exchanges and then from
+ *  the last migration.
+ */
+
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+#define BALANCETAG 4 // and BALANCETAG+1 for the flip counts
+#define BALANCEMIN 8 // fewest rows or columns of a tile
+
+typedef struct
+{
+  int freq;          // steps between checks
+  long last;         // step of the last check
+  int *rowof, *colof; // process row and column of every rank
+  double tfixed;     // predicted seconds to rebuild the grid
+  double tmove;      // and to move one cell
+  double before;     // slowest update time per step before the last move
+  double after;      // and predicted after it
+  long moved;        // most cells received by a process in the last move
+  int nmove;         // migrations done
+  double tspent;     // seconds spent migrating
+} balance;
+
+balance *balancecreate(int freq, long step0, grid **g, MPI_Comm comm,
+                       int up, int down, int left, int right);
+int  balancestep(balance *b, grid **g, long step, MPI_Comm comm);
+void balancefree(balance *b);
+
+#endif // BALANCE_H
@@ -0,0 +1,70 @@
+/*
+ *  Binary checkpoint / restart with collective MPI-IO.
+ *
+ *  A checkpoint file is a CKPTHEADER-byte header followed by the L x L
+ *  cells, one byte each, in global row-major order (cell (i, j) at
+ *  offset CKPTHEADER + i*L + j). Each process writes and reads only its
+ *  own tile, so a checkpoint can be restarted on any decomposition.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "grid.h"
+
+#define CKPTMAGIC   "AUTOCKPT"
+#define CKPTVERSION 1
+#define CKPTHEADER  128 // Bytes reserved for the header
+
+typedef struct
+{
+  char magic[8];     // CKPTMAGIC, only written once the data are complete
+  int32_t version;   // CKPTVERSION
+  int32_t l;         // system size L
+  int64_t step;      // number of steps completed
+  int32_t seed;
+  int32_t rule;      // RULE
+  double rho;
+  int64_t incells;   // initial number of living cells
+} ckptheader;
+
+/*
+ *  Checkpoints alternate between two slots, <name>.0 and <name>.1, so
+ *  the previous checkpoint stays intact while the next one is written.
+ *  The data of a slot are written with a non-blocking collective from
+ *  its own buffer; the header is added as soon as the write has
+ *  completed on every process, and the data are synced to disk first.
+ *  The newest completed checkpoint is then always valid on disk.
+ *
+ *  Whether the write has completed everywhere is agreed with a
+ *  non-blocking MPI_Iallreduce started on each step and waited for on
+ *  the next one, so all processes finish the slot on the same step.
+ *  At the latest it is finished by the next checkpoint.
+ */
+
+typedef struct
+{
+  const char *name;
+  int next;                  // slot to use next
+  MPI_File fh[2];
+  MPI_Request request[2];
+  unsigned char *buf[2];     // local tile, one byte per cell
+  ckptheader header[2];
+  int active[2];             // write in progress
+  int done, alldone;         // write of the active slot completed here, everywhere
+  MPI_Request agree;         // MPI_Iallreduce of done
+} checkpoint;
+
+checkpoint *ckptcreate(const char *name, grid *g);
+void ckptwrite(checkpoint *c, grid *g, ckptheader *h, MPI_Comm comm);
+void ckptpoll(checkpoint *c, MPI_Comm comm);
+void ckptresize(checkpoint *c, grid *g, MPI_Comm comm);
+void ckptfree(checkpoint *c, MPI_Comm comm);
+
+int ckptsize(const char *filename, MPI_Comm comm);
+int ckptread(const char *filename, grid *g, ckptheader *h, MPI_Comm comm);
+
+#endif // CHECKPOINT_H
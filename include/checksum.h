@@ -0,0 +1,66 @@
+/*
+ *  Position-dependent fingerprints of the grid. The fingerprint of a
+ *  set of cells is the sum (modulo 2^64) of cellhash() over its living
+ *  cells, keyed on global coordinates, so local fingerprints can be
+ *  summed over processes and updated incrementally as cells flip.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+typedef unsigned long long checksum;
+
+#define MPI_CHECKSUM MPI_UNSIGNED_LONG_LONG
+
+/*
+ *  Hash of one global row or column index: the splitmix64 finaliser,
+ *  made odd so that products of keys never vanish
+ */
+
+static inline checksum indexhash(long k, checksum salt)
+{
+  checksum z = (checksum) k + salt;
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return (z ^ (z >> 31)) | 1;
+}
+
+static inline checksum rowhash(long gi)
+{
+  return indexhash(gi, 0x9e3779b97f4a7c15ULL);
+}
+
+static inline checksum colhash(long gj)
+{
+  return indexhash(gj, 0x632be59bd9b4e019ULL);
+}
+
+/*
+ *  Hash of the global cell (gi, gj). As a product of row and column
+ *  keys it costs one multiply per cell once the keys of a row and of
+ *  the local columns are known.
+ */
+
+static inline checksum cellhash(long gi, long gj)
+{
+  return rowhash(gi)*colhash(gj);
+}
+
+/*
+ *  Change in a row's sum of column keys when a cell goes from old to
+ *  val (both 0 or 1): +key if it is born, -key if it dies, else 0.
+ *  Only logical operations and adds, so the loops calling it
+ *  vectorise without 64-bit multiplies.
+ */
+
+static inline checksum flipkey(int old, int val, checksum key)
+{
+  checksum flip = -(checksum) (old ^ val);
+  checksum dies = -(checksum) (old & (old ^ val));
+
+  return ((key & flip) ^ dies) - dies;
+}
+
+#endif // CHECKSUM_H
@@ -0,0 +1,50 @@
+/*
+ *  In-situ cluster analysis of the living cells.
+ *
+ *  Clusters are sets of living cells connected through their four
+ *  nearest neighbours, with the same boundaries as the update: the
+ *  grid is periodic in i and closed in j. A cluster spans the grid if
+ *  it touches both global columns j = 0 and j = L-1.
+ *
+ *  Every process labels its own tile with union-find. Clusters that do
+ *  not reach the edge of a tile are complete and only counted; for the
+ *  others the labels along the tile edges are exchanged with the
+ *  neighbours over the cartesian communicator and the resulting pairs
+ *  of equivalent labels are merged on rank 0.
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+#define CLUSTER_EDGE  1 // reaches the edge of the tile
+#define CLUSTER_LEFT  2 // touches global column 0
+#define CLUSTER_RIGHT 4 // touches global column L-1
+
+typedef struct
+{
+  int freq;          // steps between analyses
+  int lx, ly;
+  unsigned char *cell;   // local tile, one byte per cell
+  long *parent;          // union-find forest over the local cells
+  long *size;            // cells in the tree of each root
+  unsigned char *flags;  // CLUSTER_EDGE, CLUSTER_LEFT, CLUSTER_RIGHT per root
+  long *send[2];         // labels of row 1 and of column 1, -1 if dead
+  long *halo[2];         // labels of the rows and columns next to the tile
+
+  // results of the last analysis, the same on every process
+
+  long nclusters;
+  long largest;      // cells in the largest cluster
+  int spanning;      // 1 if a cluster touches both j = 0 and j = L-1
+} cluster;
+
+cluster *clustercreate(int freq, grid *g);
+int  clusterstep(cluster *c, grid *g, long step, MPI_Comm comm,
+                 int up, int down, int left, int right);
+void clusterfree(cluster *c);
+
+#endif // CLUSTER_H
@@ -0,0 +1,36 @@
+/*
+ *  Detection of fixed points and periodic orbits from the global
+ *  fingerprint of every step. Local fingerprints are buffered and
+ *  summed over all processes in one reduction every freq steps.
+ */
+
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include <mpi.h>
+
+#include "checksum.h"
+
+#define CYCLECONFIRM 4 // Consecutive repeats needed to report a cycle
+
+typedef struct
+{
+  int freq;          // steps between reductions
+  int maxperiod;     // longest period looked for
+  int nbuf;          // local fingerprints waiting to be reduced
+  checksum *local;   // local fingerprints of the last nbuf steps
+  checksum *global;  // the same, summed over processes
+  int nhist;         // length of the history ring
+  long nstep;        // fingerprints seen so far
+  long step0;        // step of the first fingerprint
+  checksum *hist;    // fingerprint number s at hist[s % nhist]
+
+  int period;        // period found, 0 if none
+  long start;        // earliest step known to be on the cycle
+} cycle;
+
+cycle *cyclecreate(int freq, int maxperiod);
+void   cyclefree(cycle *c);
+int    cyclepush(cycle *c, long step, checksum local, MPI_Comm comm);
+
+#endif // CYCLE_H
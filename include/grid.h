@@ -0,0 +1,211 @@
+/*
+ *  Storage for the local part of the automaton. The rest of the
+ *  program only sees cells through the accessors below, so the data
+ *  can be held either row-major with halos, as in the original code,
+ *  in cache-sized blocks with separate contiguous halo strips, or one
+ *  byte per cell in a memory-mapped file for tiles larger than memory.
+ *
+ *  Cells are addressed as in the original cell array: the interior is
+ *  1 <= i <= lx, 1 <= j <= ly and the halos are i = 0, lx+1 and
+ *  j = 0, ly+1. Corner halo cells are never used by the update.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <mpi.h>
+
+#include "checksum.h"
+
+#define GRID_ROWMAJOR 0 // (lx+2) x (ly+2) array with halos
+#define GRID_TILED    1 // GRIDBX x GRIDBY blocks plus halo strips
+#define GRID_MAPPED   2 // rows of bytes in a mapped file plus halo strips
+
+#define GRIDBX 32 // Block size of the tiled layout
+#define GRIDBY 64
+
+/*
+ *  Update engine of the tiled layout. In GRID_SPARSE a block with at
+ *  most SPARSELIVE living cells is next updated from the list of
+ *  them, at a cost of its perimeter plus its living cells, until it
+ *  has more than SPARSEMAX; then it is updated in full again.
+ */
+
+#define GRID_DENSE  0 // every block updated in full
+#define GRID_SPARSE 1 // blocks switch between full and list updates
+
+#define SPARSELIVE 64
+#define SPARSEMAX  (2*SPARSELIVE)
+
+/*
+ *  GRID_MAPPED updates the file in bands of rows of about MAPBAND
+ *  bytes. While a band is updated the next one is read ahead and the
+ *  one before is written back and dropped from memory, so only about
+ *  three bands need to be resident.
+ */
+
+#define MAPBAND (1 << 22)
+
+/*
+ *  How the strided column halos of the row-major layout are sent
+ */
+
+#define HALO_VECTOR 0 // MPI_Type_vector straight from cell
+#define HALO_MANUAL 1 // SSE2 transposed copy into contiguous buffers
+#define HALO_PACK   2 // MPI_Pack / MPI_Unpack
+#define HALO_AUTO   3 // time the others at startup, keep the fastest
+
+#define HALOTRIALS 100 // Exchanges timed per strategy
+#define ASYNCTAG   10  // Tags ASYNCTAG to ASYNCTAG+3 are used by gridstepasync
+                       // and the halo swap of GRID_SPARSE
+#define AHEADTAG   20  // Tags from AHEADTAG up are used by gridstepahead
+
+/*
+ *  Boundary and halo strips of the tiled layout
+ */
+
+#define STRIP_UP    0 // row 1 / halo row 0
+#define STRIP_DOWN  1 // row lx / halo row lx+1
+#define STRIP_LEFT  2 // column 1 / halo column 0
+#define STRIP_RIGHT 3 // column ly / halo column ly+1
+
+/*
+ *  State of gridstepahead between two steps at which all the blocks
+ *  are level. Block b has reached step[b]; the blocks and strips of
+ *  steps t0, t0+2, ... are in buf[0] and strip[0] (the grid's own
+ *  arrays) and those of t0+1, t0+3, ... in buf[1] and strip[1], and
+ *  likewise the halos. Halos go segment by segment, one segment per
+ *  edge block, with request, slot and step arrays indexed by
+ *  seg[s] + 2*k + parity for segment k of side s.
+ */
+
+typedef struct
+{
+  int active;          // blocks may be at different steps
+  long t0;             // step at which the blocks were last level
+  long low;            // step every block has reached
+  long cap;            // step no block goes beyond
+  long *step;          // step reached by each block
+  int **buf[2];
+  int *strip[2][4];
+  int *halo[2][4];
+  int seg[5];          // first index of each side, and the total
+  MPI_Request *recv, *send;
+  long *want;          // step a receive was posted for
+  long *have;          // step whose halo segment is in a slot, or -1
+  int *ready;          // blocks updated in one round
+  int *rcell;          // ... their living cells
+  checksum *rhash;
+  long *rflip;
+  int nring;           // steps in flight: ahead+2
+  long *ncell, *nflip; // living cells and flips of each step in flight
+  int *ndone;          // blocks that have reached each step in flight
+} gridahead;
+
+typedef struct
+{
+  int layout;
+  int lx, ly;   // local interior size
+  int x0, y0;   // global position of interior cell (1, 1)
+
+  /*
+   *  If track is set, the update keeps hash equal to the fingerprint
+   *  of the local interior by adding or removing the cellhash of
+   *  every cell that flips
+   */
+
+  int track;
+  checksum hash;
+  checksum *colkey; // colhash of the local columns, colkey[j-1]
+
+  /*
+   *  If flips is set, the update also counts the cells that flip:
+   *  nflip on the last step and flips[(i-1)*ly + j-1] in total
+   */
+
+  unsigned int *flips;
+  long nflip;
+
+  gridahead *ahead;  // gridstepahead, or NULL
+
+  double tstep;      // seconds spent updating cells, for load balancing
+  long halobytes[4]; // bytes sent to each side by the halo exchanges
+
+  /*
+   *  GRID_ROWMAJOR
+   */
+
+  int **cell;   // cells with halos
+  int **neigh;  // number of living neighbours
+  long (*kernel)(int **cell, int lx); // update specialised on ly, or NULL
+  MPI_Datatype column; // one interior column of cell
+  int halomode;        // HALO_VECTOR, HALO_MANUAL or HALO_PACK
+  int packsize;        // bytes in a packed column
+  void *colsend[2];    // packed columns 1 and ly
+  void *colrecv[2];    // packed columns 0 and ly+1
+
+  /*
+   *  GRID_TILED: the interior lives in blocks, its four boundary
+   *  strips are also kept in contiguous buffers which are sent as
+   *  they are, and halos are received into contiguous strips.
+   */
+
+  int nbx, nby;      // number of blocks in each direction
+  int **block;       // block[bi*nby+bj] is GRIDBX x GRIDBY, row-major
+  int **next;        // blocks for the next step
+  int *strip[4];     // boundary strips (copies of interior cells)
+  int *halo[4];      // halo strips
+
+  /*
+   *  GRID_SPARSE: nlive[b] >= 0 is the number of living cells of
+   *  block b, at positions ii*GRIDBY + jj live[b][0] ...; -1 if the
+   *  block is not listed. nlivenext and livenext do the same for
+   *  next. Halos go as lists of living cells when that is shorter.
+   */
+
+  int *nlive, *nlivenext;
+  unsigned short **live, **livenext;
+  int *stripsend[4], *striprecv[4]; // count or -1, then cells
+  long nsparse, nupdate;            // block updates from lists, and all
+
+  /*
+   *  GRID_MAPPED: cell (i, j) is map[(i-1)*ly + j-1] of a scratch file
+   *  in the directory set by gridmapdir, which is removed as soon as it
+   *  is mapped. The strips and halos are kept as in GRID_TILED.
+   */
+
+  int mapfd;
+  unsigned char *map;
+  size_t mapsize;
+  int nband;                // rows per band
+  unsigned char *rowbuf[3]; // old rows i-1 and i, and the halo row lx+1
+} grid;
+
+grid *gridcreate(int lx, int ly, int layout);
+void  gridmapdir(const char *dir);
+void  gridfree(grid *g);
+
+int   gridget(grid *g, int i, int j);
+void  gridset(grid *g, int i, int j, int val);
+void  gridgetrow(grid *g, int i, int *row);
+void  gridsetrow(grid *g, int i, const int *row);
+
+void  gridhalo(grid *g, MPI_Comm comm, int up, int down, int left, int right);
+int   gridhalotune(grid *g, MPI_Comm comm, int up, int down, int left, int right,
+                   double *times);
+void  gridboundary(grid *g);
+long  gridstep(grid *g);
+long  gridstepasync(grid *g, MPI_Comm comm, int up, int down, int left, int right);
+long  gridstepahead(grid *g, MPI_Comm comm, int up, int down, int left, int right,
+                    long step, int ahead, long cap);
+checksum gridchecksum(grid *g);
+long  gridcount(grid *g);
+
+void  gridgetbytes(grid *g, unsigned char *buf);
+void  gridsetbytes(grid *g, const unsigned char *buf);
+MPI_Datatype gridfiletype(grid *g, MPI_Datatype etype);
+void  gridtrack(grid *g);
+void  gridflips(grid *g);
+void  gridsparse(grid *g);
+
+#endif // GRID_H
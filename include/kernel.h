@@ -0,0 +1,21 @@
+/*
+ *  Update and halo copy loops of the row-major layout, on plain
+ *  (lx+2) x (ly+2) arrays with halos. They use no MPI, so they can be
+ *  timed on their own by kernelbench as well as called from grid.c.
+ *
+ *  Each update applies the rule to cells 1 <= i <= lx, 1 <= j <= ly
+ *  in place and returns the number of living cells.
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+void kernelsum(int **cell, int **neigh, int lx, int ly);
+long kerneltwopass(int **cell, int **neigh, int lx, int ly);
+long kernelfused(int **cell, int lx, int ly);
+long (*kernelwidth(int ly))(int **cell, int lx);
+
+void kernelpackcolumns(int **cell, int lx, int ly, int *l, int *r);
+void kernelunpackcolumn(int **cell, int lx, int j, const int *c);
+
+#endif // KERNEL_H
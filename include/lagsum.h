@@ -0,0 +1,29 @@
+/*
+ *  Global sums of a per-step count that may complete some steps late.
+ *
+ *  Each step starts a non-blocking MPI_Iallreduce and carries on; the
+ *  result of a step is only waited for once lag newer steps have been
+ *  started. A process is then only held up by the slowest one if it
+ *  falls lag steps behind.
+ */
+
+#ifndef LAGSUM_H
+#define LAGSUM_H
+
+#include <mpi.h>
+
+typedef struct
+{
+  int lag;               // steps a sum may be outstanding
+  int first, n;          // oldest outstanding sum and number outstanding
+  long *step;
+  long *local, *global;
+  MPI_Request *request;
+} lagsum;
+
+lagsum *lagcreate(int lag);
+void lagpush(lagsum *l, long step, long local, MPI_Comm comm);
+int  lagpop(lagsum *l, long *step, long *global, int wait);
+void lagfree(lagsum *l);
+
+#endif // LAGSUM_H
@@ -0,0 +1,28 @@
+/*
+ *  MPI transfers of more than INT_MAX elements.
+ *
+ *  Counts are int in MPI before MPI-4 and the large-count (_c) calls
+ *  are not in every library we build with, so a long count is either
+ *  split into collectives of at most LARGECHUNK elements, or, where
+ *  there must be a single call such as a collective write, described
+ *  as one element of a derived type. Counts up to INT_MAX go straight
+ *  through with the type given, so small grids make the same calls
+ *  as before.
+ */
+
+#ifndef LARGECOUNT_H
+#define LARGECOUNT_H
+
+#include <mpi.h>
+
+#define LARGECHUNK (1L << 30) // Elements per call of a split collective
+
+void largebcast(void *buf, long count, MPI_Datatype type, int root,
+                MPI_Comm comm);
+void largereduce(const void *sendbuf, void *recvbuf, long count,
+                 MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm);
+
+int  largetype(long count, MPI_Datatype type, MPI_Datatype *big);
+void largefree(MPI_Datatype *big, MPI_Datatype type);
+
+#endif // LARGECOUNT_H
@@ -0,0 +1,92 @@
+/*
+ *  Run metrics for dashboards, written every freq steps.
+ *
+ *  METRICS_JSON appends one JSON object per line to the file:
+ *
+ *    {"step":..., "time":..., "ncell":..., "steps_per_s":...,
+ *     "cells_per_s":..., "halo_bytes_per_s":...,
+ *     "phase_s":{"halo":..., "update":..., "reduce":..., "output":...}}
+ *
+ *  and a last line with "final":true and "ms_per_step" when the run
+ *  ends. Rates are over the steps since the previous line. A phase
+ *  time is the time the slowest process spent in that phase over
+ *  those steps; with -async the halo swap overlaps the update and is
+ *  counted in it.
+ *
+ *  METRICS_PROM replaces the file with the latest sample in the
+ *  Prometheus text format, for the node exporter textfile collector.
+ *  Each sample is written to <file>.tmp, which is renamed over the
+ *  file once the write has completed, so the collector never reads a
+ *  sample half written.
+ *
+ *  Nothing in the step loop waits for the metrics: the per-process
+ *  values of a sample are reduced to rank 0 with non-blocking
+ *  collectives that are only tested on later steps, and rank 0 hands
+ *  the text to a non-blocking write. A process only waits if the
+ *  previous sample has still not been reduced freq steps later, or
+ *  all METRICBUFFERS writes (with METRICS_PROM, the previous write)
+ *  are still in flight.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+#define METRICS_JSON 0
+#define METRICS_PROM 1
+
+#define METRIC_HALO   0
+#define METRIC_UPDATE 1
+#define METRIC_REDUCE 2
+#define METRIC_OUTPUT 3
+#define METRIC_PHASES 4
+
+#define METRICBUFFERS 4    // Writes that can be in flight at once
+#define METRICLINE    1024 // Bytes of text per sample
+
+typedef struct
+{
+  MPI_File fh;       // open on rank 0 only
+  char *name;        // of the file
+  char *tmpname;     // METRICS_PROM: <name>.tmp, renamed to name
+  int replace;       // METRICS_PROM: tmpname is written but not renamed
+  MPI_Comm comm;
+  int rank;
+  int format;
+  int freq;
+  double t0;         // start of the run
+
+  double phase[METRIC_PHASES]; // local time in each phase since the last sample
+  double total[METRIC_PHASES]; // and over the run
+  double mark;       // start of the current phase
+
+  long step;         // step of the sample being reduced
+  double time;       // and its wall time on rank 0
+  long step0;        // step the run started from
+  long laststep;     // previous sample written
+  double lasttime;
+  long lastbytes;    // local halo bytes sent up to the previous sample
+
+  long sum[2], allsum[2];  // local cells and halo bytes, summed
+  double max[METRIC_PHASES], allmax[METRIC_PHASES]; // phase times, max
+  MPI_Request request[2];
+  int pending;       // a sample is being reduced
+
+  char *buf[METRICBUFFERS];
+  MPI_Request write[METRICBUFFERS];
+  int next;          // buffer of the next write
+  MPI_Offset end;    // METRICS_JSON: end of the lines written
+
+  int nwait;         // samples that waited for a reduction or a buffer
+} metrics;
+
+metrics *metricscreate(const char *name, int format, int freq, long step0,
+                       MPI_Comm comm);
+void metricsphase(metrics *m, int phase);
+void metricsstep(metrics *m, grid *g, long step, long localncell);
+void metricsfree(metrics *m, grid *g, long step, long localncell);
+
+#endif // METRICS_H
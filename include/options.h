@@ -0,0 +1,49 @@
+/*
+ *  Run-time options: automaton <seed> [-option value] ...
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+typedef struct
+{
+  int tile;   // cells per side of a tile, 0 for L = LDEFAULT
+  int layout; // GRID_ROWMAJOR, GRID_TILED or GRID_MAPPED
+  const char *mapdir; // directory of the GRID_MAPPED files
+  int engine; // GRID_DENSE or GRID_SPARSE
+  int halo;   // HALO_VECTOR, HALO_MANUAL, HALO_PACK or HALO_AUTO
+  int cycle;  // steps between cycle checks, 0 for none
+  int cycleperiod; // longest period detected
+  int verify;           // steps between checksums, 0 for none
+  const char *trace;    // checksum trace written
+  const char *golden;   // checksum trace compared with, or NULL
+  int checkpoint;       // steps between checkpoints, 0 for none
+  const char *ckptfile; // checkpoints go to <ckptfile>.0 and .1
+  const char *restart;  // checkpoint to start from, or NULL
+  const char *input;    // pattern to start from, or NULL
+  int snapshot;         // steps between snapshot frames, 0 for none
+  const char *snapfile; // snapshot time series
+  int snapformat;       // SNAP_RAW or SNAP_RLE
+  int cluster;          // steps between cluster analyses, 0 for none
+  int stats;            // steps between statistics output, 0 for none
+  const char *statsfile; // statistics time series
+  int image;            // IMAGE_FULL, IMAGE_WINDOW or IMAGE_COARSE
+  const char *window;   // "x,y,nx,ny" for IMAGE_WINDOW
+  int coarse;           // block size for IMAGE_COARSE
+  int rng;              // RNG_UNI or RNG_COUNTER
+  int async;            // steps the global count may lag, 0 for in step
+  int ahead;            // steps a block may run ahead of the slowest, 0 for none
+  int balance;          // steps between load balancing checks, 0 for none
+  int procgrid;         // TOPO_DIMS or TOPO_PLAN
+  int nodesize;         // ranks per node assumed, 0 to detect
+  int sweep;            // bisections of rholo ... rhohi, 0 for one run
+  double rholo, rhohi;  // range of rho swept
+  int metrics;          // steps between metrics samples, 0 for none
+  const char *metricsfile; // metrics file
+  int metricsformat;    // METRICS_JSON or METRICS_PROM
+} autooptions;
+
+int  getoptions(int argc, char *argv[], autooptions *opt);
+void printusage(void);
+
+#endif // OPTIONS_H
@@ -0,0 +1,46 @@
+/*
+ *  MPI datatypes for records (C structs) described by a list of
+ *  fields, and for moving n records between an array of structs (AoS)
+ *  and one array per field (SoA).
+ *
+ *  The type of one record takes its displacements from offsetof and
+ *  is resized to sizeof the struct, so trailing padding (e.g. after
+ *  the char of {int, char, double} reordered as {double, int, char})
+ *  is stepped over when count > 1.
+ *
+ *  A message between the two layouts is sent field by field: all n
+ *  values of the first field, then all of the second, and so on. Both
+ *  ends are described by one block per field, a strided vector over
+ *  the structs or a contiguous array, instead of one block per field
+ *  per record, so building and processing the types costs the same
+ *  for any n.
+ *
+ *  The types are built from at least one field; for nf < 1 the type
+ *  functions return MPI_DATATYPE_NULL.
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <mpi.h>
+
+typedef struct
+{
+  MPI_Datatype type; // of one element of the field
+  int count;         // elements per record, e.g. 3 for double x[3]
+  MPI_Aint offset;   // offsetof the field in the struct
+} recordfield;
+
+#define RECORDFIELD(s, member, type, count) {type, count, offsetof(s, member)}
+
+MPI_Datatype recordtype(const recordfield *f, int nf, MPI_Aint extent);
+MPI_Datatype recordaos(const recordfield *f, int nf, MPI_Aint extent, int n);
+MPI_Datatype recordsoa(const recordfield *f, int nf, void **arrays, int n);
+
+void recordpack(const recordfield *f, int nf, MPI_Aint extent, const void *aos,
+                int n, void **arrays);
+void recordunpack(const recordfield *f, int nf, MPI_Aint extent, void *aos,
+                  int n, void **arrays);
+
+#endif // RECORD_H
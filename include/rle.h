@@ -0,0 +1,22 @@
+/*
+ *  Compression of a tile of cells (one byte per cell, 0 or 1).
+ *
+ *  The first byte gives the encoding. RLE_RUNS is followed by the
+ *  lengths of alternating runs of dead and living cells, starting
+ *  with dead (possibly an empty run), each as a little-endian base-128
+ *  varint. RLE_BITS is the cells packed eight to a byte, first cell in
+ *  the top bit, and is used when the runs would not be smaller.
+ */
+
+#ifndef RLE_H
+#define RLE_H
+
+#define RLE_RUNS 0
+#define RLE_BITS 1
+
+#define RLEBOUND(n) (((n)+7)/8 + 8) // Bytes needed to encode n cells
+
+long rleencode(const unsigned char *cell, long n, unsigned char *out);
+int  rledecode(const unsigned char *in, long size, unsigned char *cell, long n);
+
+#endif // RLE_H
@@ -0,0 +1,37 @@
+/*
+ *  Random numbers in bulk.
+ *
+ *  RNG_COUNTER: number n of stream s is a hash of (seed, s, n), using
+ *  the SplitMix64 Weyl sequence and finaliser. There is no state to
+ *  carry from one number to the next, so a whole buffer is filled by
+ *  a loop the compiler can vectorise, any position can be jumped to
+ *  directly and different streams are independent. Each process can
+ *  then draw exactly the numbers of its own cells.
+ *
+ *  RNG_UNI: Marsaglia's UNI from unirand.c, for the sequence of the
+ *  original code. It has one global state, so there is only one
+ *  stream and jumping ahead draws and discards the numbers.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+#define RNG_UNI     0
+#define RNG_COUNTER 1
+
+typedef struct
+{
+  int mode;          // RNG_UNI or RNG_COUNTER
+  uint64_t key;      // from the seed
+  uint64_t stream;   // from the substream number
+  uint64_t counter;  // position in the stream
+} rng;
+
+void rngseed(rng *r, int mode, int seed);
+rng  rngsubstream(const rng *r, uint64_t s);
+void rngjump(rng *r, uint64_t n);
+void rngfill(rng *r, float *buf, long n);
+
+#endif // RNG_H
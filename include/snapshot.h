@@ -0,0 +1,101 @@
+/*
+ *  Time series of snapshots streamed to disk during the run.
+ *
+ *  The file starts with a SNAPHEADER-byte header and holds one frame
+ *  every freq steps, starting at step first, so frame k holds step
+ *  first + k*freq. The header is written when the file is closed;
+ *  until then its magic is zero.
+ *
+ *  SNAP_RAW: frame k is the L x L cells, one byte each, in global
+ *  row-major order like a checkpoint, at SNAPHEADER + k*L*L.
+ *
+ *  SNAP_RLE: every process compresses its own tile (see rle.h) and
+ *  the tiles of a frame are stored one after another. The header is
+ *  followed by ntiles snaptile records giving the position of each
+ *  tile, and the file ends with the index, at offset index: for every
+ *  frame, ntiles snapentry records giving where its tiles are. Use
+ *  snapdecode to turn frames back into PBM files.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "grid.h"
+
+#define SNAPMAGIC   "AUTOSNAP"
+#define SNAPVERSION 2
+#define SNAPHEADER  128 // Bytes reserved for the header
+#define SNAPBUFFERS 4   // Frames that can be in flight at once
+
+#define SNAP_RAW 0
+#define SNAP_RLE 1
+
+typedef struct
+{
+  char magic[8];     // SNAPMAGIC
+  int32_t version;   // SNAPVERSION
+  int32_t l;         // system size L
+  int64_t first;     // step of frame 0
+  int32_t freq;      // steps between frames
+  int32_t rule;      // RULE
+  int64_t nframes;
+  int32_t format;    // SNAP_RAW or SNAP_RLE
+  int32_t ntiles;    // SNAP_RLE: number of tiles in a frame
+  int64_t index;     // SNAP_RLE: offset of the index
+} snapheader;
+
+typedef struct
+{
+  int32_t x0, y0;    // global position of the first cell of the tile
+  int32_t lx, ly;
+} snaptile;
+
+typedef struct
+{
+  int64_t offset;    // of the compressed tile in the file
+  int64_t size;      // in bytes
+} snapentry;
+
+/*
+ *  Each frame is copied into the next buffer of a ring and written
+ *  with a non-blocking collective, so the ranks carry on stepping
+ *  while it drains. If the writer falls behind, taking a frame waits
+ *  for the oldest write to complete before reusing its buffer.
+ */
+
+typedef struct
+{
+  MPI_File fh;
+  MPI_Comm comm;
+  int freq;
+  int lx, ly;
+  snapheader header;
+  unsigned char *buf[SNAPBUFFERS];
+  MPI_Request request[SNAPBUFFERS];
+  long nframes;
+
+  /*
+   *  SNAP_RLE
+   */
+
+  unsigned char *tile;  // uncompressed local tile
+  MPI_Offset end;       // end of the data written so far
+  long *sizes;          // compressed size of every tile of a frame
+  snapentry *index;     // on rank 0, ntiles entries per frame
+  long nindex;          // frames the index has room for
+  double bytes;         // compressed bytes written by all processes
+
+  double tcopy;   // time spent copying frames out of the grid
+  double twait;   // time spent waiting for the writer
+  int nwait;      // frames that had to wait for a free buffer
+} snapshot;
+
+snapshot *snapcreate(const char *name, int format, int freq, long step0,
+                     grid *g, MPI_Comm comm);
+void snapstep(snapshot *s, grid *g, long step);
+void snapfree(snapshot *s);
+
+#endif // SNAPSHOT_H
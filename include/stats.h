@@ -0,0 +1,65 @@
+/*
+ *  Per-step statistics written to a binary time series.
+ *
+ *  The series file is a STATSHEADER-byte header followed by one
+ *  statsrecord per step. The number of flips is counted by the update
+ *  into local counters and only reduced every freq steps, when a block
+ *  of records is written by rank 0.
+ *
+ *  The heatmap file <name>.heat, written at the end of the run, is a
+ *  STATSHEADER-byte header followed by the number of times each cell
+ *  flipped over the run as L x L uint32 in global row-major order.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mpi.h>
+
+#include "grid.h"
+
+#define STATSMAGIC   "AUTOSTAT"
+#define HEATMAGIC    "AUTOHEAT"
+#define STATSVERSION 1
+#define STATSHEADER  64 // Bytes reserved for the headers
+
+typedef struct
+{
+  char magic[8];     // STATSMAGIC or HEATMAGIC
+  int32_t version;   // STATSVERSION
+  int32_t l;         // system size L
+  int64_t first;     // first step counted
+  int64_t last;      // heatmap: last step counted
+} statsheader;
+
+typedef struct
+{
+  int64_t step;
+  int64_t ncell;     // living cells
+  int64_t nflip;     // cells that changed on this step
+  double density;    // ncell / L^2
+} statsrecord;
+
+typedef struct
+{
+  const char *name;
+  int freq;          // steps between reductions
+  FILE *fp;          // time series, open on rank 0
+  long first, last;  // steps counted
+  int n;             // steps buffered
+  long *step;        // buffered steps, ncell and local flips
+  long *ncell;
+  long *nflip;
+  long *allflip;     // flips summed over all processes
+  statsrecord *record;
+} stats;
+
+stats *statscreate(const char *name, int freq, long step0, grid *g,
+                   MPI_Comm comm, int rank);
+void statsstep(stats *s, grid *g, long step, long ncell, MPI_Comm comm,
+               int rank);
+void statsfree(stats *s, grid *g, MPI_Comm comm, int rank);
+
+#endif // STATS_H
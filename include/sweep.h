@@ -0,0 +1,37 @@
+/*
+ *  Sweeps over the initial density rho from one field of numbers.
+ *
+ *  The initial cells of any rho are those whose uniform number is
+ *  below rho, so the numbers of the local tile are drawn once per
+ *  seed and each point of the sweep only thresholds them and runs the
+ *  automaton again on the same grid, buffers and processes.
+ *
+ *  The outcome of a point is the step on which the run terminates
+ *  (the living cells leave 3/4 ... 4/3 of the initial number), or 0
+ *  if it reaches maxstep. From the two ends of a range where one
+ *  terminates and the other does not, the range is halved towards
+ *  the rho at which the outcome changes.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+typedef struct
+{
+  float *u;     // numbers of the local tile, cell (i, j) at u[(i-1)*ly + j-1]
+  int *row;     // cells of one row
+  int maxstep;
+} sweep;
+
+sweep *sweepcreate(grid *g, int mode, int seed, int maxstep, MPI_Comm comm);
+void   sweepfree(sweep *w);
+int    sweeprun(sweep *w, grid *g, double rho, long *incells, MPI_Comm comm,
+                int up, int down, int left, int right);
+void   sweepbisect(sweep *w, grid *g, double lo, double hi, int n,
+                   MPI_Comm comm, int up, int down, int left, int right);
+
+#endif // SWEEP_H
@@ -0,0 +1,51 @@
+/*
+ *  Choice of the process grid and of the process placed at each of
+ *  its positions.
+ *
+ *  The nodes are found with MPI_Comm_split_type (or taken to be
+ *  blocks of nodesize consecutive ranks). TOPO_DIMS keeps the grid of
+ *  MPI_Dims_create with ranks in row-major order, as before. TOPO_PLAN
+ *  tries every grid px x py = size, 1D strips included, each with the
+ *  row-major placement and, if every node has the same number of
+ *  ranks q, with every node block shape nx x ny = q that tiles it:
+ *  node k then holds a block of nx x ny neighbouring positions. The
+ *  halo bytes of every link are counted from the tile sizes of setXY,
+ *  and the placement with the fewest bytes between nodes, then within
+ *  nodes, then to the process itself, is chosen.
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <mpi.h>
+
+#define TOPO_DIMS 0 // MPI_Dims_create, row-major
+#define TOPO_PLAN 1 // fewest halo bytes between nodes
+
+/*
+ *  Link classes
+ */
+
+#define TOPO_SELF    0 // periodic neighbour is the process itself
+#define TOPO_NODE    1 // same node
+#define TOPO_NETWORK 2 // different nodes
+#define TOPO_CLASSES 3
+
+typedef struct
+{
+  int size;
+  int nnodes;
+  int nodesize;      // ranks per node, 0 if they differ
+  int *node;         // node of every rank of the reordered communicator
+  int dims[2];       // process grid
+  int nodedims[2];   // node block shape, 0 x 0 for row-major
+  long predicted[TOPO_CLASSES]; // halo bytes sent per step
+} topology;
+
+topology *topocreate(int mode, int nodesize, int l, MPI_Comm comm,
+                     MPI_Comm *newcomm);
+void topopredict(topology *t, int l);
+int  topoclass(topology *t, int rank, int other);
+void topofree(topology *t);
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,42 @@
+/*
+ *  Verification mode: the checksum of the whole grid (the sum of
+ *  cellhash over living cells) is computed from scratch every freq
+ *  steps, written to a trace file on rank 0 and, if a golden trace is
+ *  given, compared with it. The checksum depends only on the global
+ *  state, so traces from any process count, layout or kernel must be
+ *  identical to the trace of the reference run.
+ *
+ *  A comparison fails if a checksum or living cell count differs, if a
+ *  step from the first one checked on is in only one of the traces
+ *  (which includes traces ending at different steps), or if nothing
+ *  could be compared.
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdio.h>
+#include <mpi.h>
+
+#include "grid.h"
+
+typedef struct
+{
+  int freq;        // steps between checksums
+  FILE *trace;     // trace being written (rank 0)
+  FILE *golden;    // trace to compare with (rank 0), or NULL
+  int compare;     // a golden trace was asked for
+  long nchecked;   // checksums compared with the golden trace
+  long nbad;       // ... and how many of them differed
+  long firstbad;   // step of the first difference
+  long nmissing;   // steps in only one of the traces
+  long firstmissing;
+} verify;
+
+verify *verifycreate(int freq, const char *tracefile, const char *goldenfile,
+                     int rank);
+void    verifystep(verify *v, grid *g, long step, long ncell, MPI_Comm comm,
+                   int rank);
+int     verifyfree(verify *v, int rank);
+
+#endif // VERIFY_H
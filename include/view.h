@@ -0,0 +1,26 @@
+/*
+ *  Images of the grid that do not need the whole grid on rank 0: a
+ *  rectangular window of the cells, gathered from the processes that
+ *  own part of it, and a coarse greyscale image of the density in
+ *  k x k blocks, summed by every process on its own tile first.
+ *
+ *  Both follow the orientation of autowritedynamic: cell (0, 0) is in
+ *  the bottom-left-hand corner and i runs across the image.
+ */
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <mpi.h>
+
+#include "grid.h"
+
+#define IMAGE_FULL   0 // whole grid gathered to rank 0, as originally
+#define IMAGE_WINDOW 1 // cells of a window only
+#define IMAGE_COARSE 2 // density in k x k blocks
+
+int  viewparse(const char *s, int *window);
+void viewwindow(grid *g, const int *window, char *file, MPI_Comm comm);
+void viewcoarse(grid *g, int k, char *file, MPI_Comm comm);
+
+#endif // VIEW_H
@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arraymalloc.h"
 
 void **arraymalloc2d(int nx, int ny, size_t typesize)
 {
@@ -58,3 +62,102 @@ void ***arraymalloc3d(int nx, int ny, int nz, size_t typesize)
     }
   return array3d;
 }
+
+/*
+ *  Aligned and padded version of arraymalloc2d. The row pointers are
+ *  still stored in front of the data, so the result is indexed as
+ *  array[i][j] and released with a single free() exactly as before.
+ *
+ *  The first row starts on an "align"-byte boundary (at least a cache
+ *  line) and every row is "pitch" elements long; a pitch shorter than
+ *  ny selects arraypitch(ny), which keeps every row cache-line aligned. If
+ *  hugepage is non-zero the data are aligned to a huge page and
+ *  advised to use transparent huge pages where the OS supports it.
+ *
+ *  The data are zeroed here. When compiled with OpenMP each thread
+ *  zeroes the rows it owns under a static schedule, so pages are first
+ *  touched (and hence placed) by the thread that updates them later.
+ *  The schedule is that of the update loops, over rows 1 ... nx-2 of
+ *  a tile with one halo row either side; each halo row is touched by
+ *  the thread owning the row next to it.
+ */
+
+void **arraymalloc2daligned(int nx, int ny, size_t typesize,
+                            size_t align, int pitch, int hugepage)
+{
+  size_t it, nxt, pitcht, offset, datasize;
+  void **array2d;
+  char *data;
+  int ix;
+
+  if (align < ARRAYLINE) align = ARRAYLINE;
+  if (hugepage && align < ARRAYHUGEPAGE) align = ARRAYHUGEPAGE;
+
+  if (pitch < ny) pitch = arraypitch(ny, typesize);
+
+  nxt = nx;
+  pitcht = pitch;
+
+  // pointers first, then pad so that the data start on a boundary
+
+  offset = ((nxt*sizeof(void *) + align - 1)/align)*align;
+  datasize = nxt*pitcht*typesize;
+
+  if (posix_memalign((void **) &array2d, align, offset + datasize) != 0)
+    {
+      return NULL;
+    }
+
+  data = ((char *) array2d) + offset;
+
+#ifdef MADV_HUGEPAGE
+  if (hugepage && datasize >= ARRAYHUGEPAGE)
+    {
+      madvise(data, datasize, MADV_HUGEPAGE);
+    }
+#endif
+
+  for (it=0; it < nxt; it++)
+    {
+      array2d[it] = (void *) (data + it*pitcht*typesize);
+    }
+
+  // first touch, using the same static schedule as the update loops
+
+  if (nx < 3)
+    {
+      memset(data, 0, datasize);
+      return array2d;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (ix=1; ix <= nx-2; ix++)
+    {
+      memset(array2d[ix], 0, pitcht*typesize);
+
+      if (ix == 1)    memset(array2d[0], 0, pitcht*typesize);
+      if (ix == nx-2) memset(array2d[nx-1], 0, pitcht*typesize);
+    }
+
+  return array2d;
+}
+
+/*
+ *  Row pitch (in elements) for a row of ny elements: rounded up to a
+ *  whole number of cache lines, plus one extra line if the row length
+ *  would be a multiple of ARRAYCRITICAL bytes, where consecutive rows
+ *  map onto the same cache sets (e.g. power-of-two LY).
+ */
+
+int arraypitch(int ny, size_t typesize)
+{
+  size_t bytes;
+
+  bytes = ((ny*typesize + ARRAYLINE - 1)/ARRAYLINE)*ARRAYLINE;
+
+  if (bytes % ARRAYCRITICAL == 0) bytes += ARRAYLINE;
+
+  return (int) ((bytes + typesize - 1)/typesize);
+}
@@ -162,3 +162,118 @@ void autowritedynamic(char *cellfile, int **cell, int l)
   printf("autowritedynamic: file closed\n");
 }
 
+
+/*
+ *  As autowritedynamic, but for an nx x ny map, e.g. a window of the
+ *  cells. cell[0][0] is in the bottom-left-hand corner and
+ *  cell[nx-1][ny-1] in the top-right-hand corner.
+ */
+
+void autowriterect(char *cellfile, int **cell, int nx, int ny)
+{
+  FILE *fp;
+
+  int i, j, npix, col;
+  static int pixperline = 32; // the PBM format limits to 70 characters per line
+
+  printf("autowriterect: opening file <%s>\n", cellfile);
+
+  fp = fopen(cellfile, "w");
+
+  printf("autowriterect: writing data ...\n");
+
+  fprintf(fp, "P1\n");
+  fprintf(fp, "# Written by autowriterect\n");
+  fprintf(fp, "%d %d\n", nx, ny);
+
+  npix = 0;
+
+  for (j=ny-1; j >= 0; j--)
+    {
+      for (i=0; i < nx; i++)
+	{
+	  npix++;
+
+          // Strangely, PBM files have 1 for black and 0 for white
+
+          col = 1;
+          if (cell[i][j] == 1) col = 0;
+
+	  if (npix == 1)
+	    {
+	      fprintf(fp, "%1d", col);
+	    }
+	  else if (npix < pixperline)
+	    {
+	      fprintf(fp, " %1d", col);
+	    }
+	  else
+	    {
+	      fprintf(fp, " %1d\n", col);
+	      npix = 0;
+	    }
+	}
+    }
+
+  if (npix != 0) fprintf(fp, "\n");
+
+  printf("autowriterect: ... done\n");
+
+  fclose(fp);
+  printf("autowriterect: file closed\n");
+}
+
+/*
+ *  Function to write an nx x ny greyscale map (0 to 255) in Portable
+ *  Grey Map (PGM) format, in the same orientation as autowriterect.
+ */
+
+void autowritepgm(char *greyfile, int **grey, int nx, int ny)
+{
+  FILE *fp;
+
+  int i, j, npix;
+  static int pixperline = 16; // the PGM format limits to 70 characters per line
+
+  printf("autowritepgm: opening file <%s>\n", greyfile);
+
+  fp = fopen(greyfile, "w");
+
+  printf("autowritepgm: writing data ...\n");
+
+  fprintf(fp, "P2\n");
+  fprintf(fp, "# Written by autowritepgm\n");
+  fprintf(fp, "%d %d\n", nx, ny);
+  fprintf(fp, "%d\n", 255);
+
+  npix = 0;
+
+  for (j=ny-1; j >= 0; j--)
+    {
+      for (i=0; i < nx; i++)
+	{
+	  npix++;
+
+	  if (npix == 1)
+	    {
+	      fprintf(fp, "%3d", grey[i][j]);
+	    }
+	  else if (npix < pixperline)
+	    {
+	      fprintf(fp, " %3d", grey[i][j]);
+	    }
+	  else
+	    {
+	      fprintf(fp, " %3d\n", grey[i][j]);
+	      npix = 0;
+	    }
+	}
+    }
+
+  if (npix != 0) fprintf(fp, "\n");
+
+  printf("autowritepgm: ... done\n");
+
+  fclose(fp);
+  printf("autowritepgm: file closed\n");
+}
@@ -4,6 +4,23 @@
 
 #include "automaton.h"
 #include "arraymalloc.h"
+#include "grid.h"
+#include "options.h"
+#include "cycle.h"
+#include "verify.h"
+#include "checkpoint.h"
+#include "snapshot.h"
+#include "cluster.h"
+#include "stats.h"
+#include "view.h"
+#include "rng.h"
+#include "lagsum.h"
+#include "largecount.h"
+#include "balance.h"
+#include "topology.h"
+#include "autoread.h"
+#include "sweep.h"
+#include "metrics.h"
 
 /*
  * Parallel program to simulate a simple 2D cellular automaton
@@ -15,8 +32,7 @@ int main(int argc, char *argv[])
    *  Define the main arrays for the simulation
    */
 
-  int **cell; // Store the cells in each process with halos
-  int **neigh; // Store the number of living neighors of each cell
+  grid *g; // Store the cells in each process with halos
 
   /*
    *  Additional array WITHOUT halos for initialisation and IO. This
@@ -26,26 +42,49 @@ int main(int argc, char *argv[])
 
   int **allcell; // store all the cell
   int **tmpcell; // Temporarily store cells
-  /*
-   *  Array to store local part of allcell
-   */
-
-  int **smallcell; // Store the cells in each process without halos
+  rng gen; // Random numbers for the initial cells
+  float *rowrand; // One row of random numbers
+  int *rowcell; // One row of initial cells
 
   /*
    *  Variables that define the automaton behaviour
    */
 
   int seed;
-  int incells; // Initial number of living cells
+  autooptions opt; // Run-time options
+  long incells; // Initial number of living cells
   double rho;
   double tstart, tend; // Store and calculate the execution time
+  double halotimes[3]; // Time per halo swap of each strategy
+  cycle *cyc = NULL; // Detects fixed points and periodic orbits
+  verify *ver = NULL; // Checksum trace for validation
+  int nbad = 0; // Checksums that differ from the golden trace
+  checkpoint *ckpt = NULL; // Periodic checkpoints
+  ckptheader header; // Parameters of a checkpoint
+  snapshot *snap = NULL; // Time series of frames
+  cluster *clu = NULL; // In-situ cluster analysis
+  stats *sta = NULL; // Per-step time series
+  metrics *met = NULL; // Metrics file for dashboards
+  lagsum *lag = NULL; // Living cells summed in the background
+  sweep *sw = NULL; // Sweep of rho from one field of numbers
+  balance *bal = NULL; // Dynamic load balancing
+  topology *topo; // Process grid and placement
+  long halobytes[TOPO_CLASSES]; // Halo bytes sent in each link class
+  int neighbour[4], s, k;
+  long donestep; // Step of the last count summed in the background
+  long donecell;
+  int stop = 0;
+  int window[4]; // Origin and size of the window written by -image window
+  int step0 = 0; // Step the run starts from
+  int lfile; // L of the checkpoint or pattern started from, 0 for none
   /*
    *  Local variables
    */
 
-  int i, j, ncell, localncell, step, maxstep, printfreq;
-  double r;
+  int i, j, step, maxstep, printfreq;
+  long ncell, localncell;
+  long cap = 0; // Next step at which the blocks of -ahead are level
+  int levelfreq[5]; // Steps between the outputs that read every block
 
   /*
    *  Variables needed by MPI
@@ -55,7 +94,6 @@ int main(int argc, char *argv[])
   MPI_Comm cart_comm;
 
   int size, rank;
-  int tag = 1;
 
   int dims[2] = {0, 0};
   int periods[2] = {1, 0};
@@ -66,8 +104,127 @@ int main(int argc, char *argv[])
 
   MPI_Comm_size(comm, &size);
   MPI_Comm_rank(comm, &rank);
-  
-  MPI_Dims_create(size, 2, dims);
+
+  if (argc < 2 || getoptions(argc, argv, &opt) != 0 || opt.tile < 0 ||
+      opt.coarse < 1 || opt.async < 0 || opt.ahead < 0 || opt.balance < 0 ||
+      opt.nodesize < 0 || opt.metrics < 0 || opt.cycleperiod < 0)
+    {
+      if (rank == 0)
+        {
+          printusage();
+        }
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  /*
+   *  A checkpoint or a pattern to start from fixes L
+   */
+
+  lfile = 0;
+
+  if (opt.sweep == 0 && opt.restart != NULL)
+    {
+      lfile = ckptsize(opt.restart, comm);
+      k = (lfile == 0);
+    }
+  else if (opt.sweep == 0 && opt.input != NULL)
+    {
+      lfile = autosize(opt.input, comm);
+      k = (lfile == 0);
+    }
+  else
+    {
+      k = 0;
+    }
+
+  if (k)
+    {
+      if (rank == 0 && opt.restart != NULL)
+        {
+          printf("automaton: ERROR, cannot restart from <%s>\n", opt.restart);
+        }
+      else if (rank == 0)
+        {
+          printf("automaton: ERROR, cannot read a square pattern from <%s>\n",
+                 opt.input);
+        }
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  /*
+   *  The process grid is planned for the halo bytes of a provisional
+   *  L, the smallest with L*L >= N*N*size under -tile N
+   */
+
+  L = LDEFAULT;
+
+  if (opt.tile > 0)
+    {
+      L = opt.tile;
+
+      while ((long) L*L < (long) opt.tile*opt.tile*size) L++;
+    }
+  else if (lfile > 0)
+    {
+      L = lfile;
+    }
+
+  /*
+   * Choose the process grid and the process at each position; from
+   * here on comm is ordered as the grid
+   */
+
+  topo = topocreate(opt.procgrid, opt.nodesize, L, MPI_COMM_WORLD, &comm);
+  MPI_Comm_rank(comm, &rank);
+
+  dims[0] = topo->dims[0];
+  dims[1] = topo->dims[1];
+
+  /*
+   *  With -tile N the grid grows with the process grid for weak
+   *  scaling: L is N times its side, so every process has N x N
+   *  cells. The automaton is square, so on a process grid that is not
+   *  L stays the provisional one and the tiles are rectangles of about
+   *  N*N cells. The initial density and the boundary strips
+   *  L/6 ... 5L/6 scale with L. The halo bytes are predicted again
+   *  for the final L.
+   */
+
+  if (opt.tile > 0 && dims[0] == dims[1])
+    {
+      L = opt.tile*dims[0];
+    }
+
+  if (lfile > 0 && L != lfile)
+    {
+      if (rank == 0)
+        {
+          printf("automaton: ERROR, -tile %d gives L = %d on %d process(es), but <%s> has L = %d\n",
+                 opt.tile, L, size, opt.restart != NULL ? opt.restart : opt.input,
+                 lfile);
+        }
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  topopredict(topo, L);
+
+  if (opt.image == IMAGE_WINDOW && viewparse(opt.window, window) != 0)
+    {
+      if (rank == 0)
+        {
+          printusage();
+        }
+
+      MPI_Finalize();
+      return 1;
+    }
+
   MPI_Cart_create(comm, 2, dims, periods, 0, &cart_comm);
   MPI_Cart_coords(cart_comm, rank, 2, coords);
   MPI_Cart_shift(cart_comm, 0, 1, &up, &down);
@@ -86,49 +243,86 @@ int main(int argc, char *argv[])
 
   LLX = LXX[0];
   LLY = LYY[0];
-  
-  cell = (int **) arraymalloc2d(LX+2, LY+2, sizeof(int));
-  neigh = (int **) arraymalloc2d(LX+2, LY+2, sizeof(int));
-  allcell = (int **) arraymalloc2d(L, L, sizeof(int));
-  tmpcell = (int **) arraymalloc2d(L, L, sizeof(int));
-  smallcell = (int **) arraymalloc2d(LX, LY, sizeof(int));
-  
+
   /*
-   * Non-periodic boundary conditions
-   *
-   * Note that the special rank of MPI_PROC_NULL is a "black hole" for
-   * communications. Using this value for processes off the edges of
-   * the grid means there is no additional logic needed to ensure
-   * processes at the edges do not attempt to send to or receive from
-   * invalid ranks (i.e. rank = -1 and rank = NPROC).
-   *
-   * A full solution would compute neighbours in a Cartesian topology
-   * via MPI_Cart_shift where MPI_PROC_NULL is assigned automatically.
+   *  Blocks running ahead swap their halos as -async does, are updated
+   *  in full and cannot be read on every step
    */
 
-  if (dims[0] * dims[1] != size)
+  if (opt.ahead > 0 && (opt.cycle > 0 || opt.stats > 0))
     {
       if (rank == 0)
         {
-          printf("automaton: ERROR, NPROC = %d running on %d process(es)\n",
-                 NPROC, size);
+          printf("automaton: -ahead is off with %s, which reads every step\n",
+                 opt.cycle > 0 ? "-cycle" : "-stats");
         }
 
-      MPI_Finalize();
-      return 1;
+      opt.ahead = 0;
+    }
+
+  if (opt.ahead > 0 && opt.async == 0)
+    {
+      if (rank == 0) printf("automaton: -ahead uses -async 1\n");
+
+      opt.async = 1;
     }
 
-  if (argc != 2)
+  if (opt.ahead > 0 && opt.engine == GRID_SPARSE)
+    {
+      if (rank == 0) printf("automaton: -ahead uses -engine dense\n");
+
+      opt.engine = GRID_DENSE;
+    }
+
+  // asynchronous and sparse steps are scheduled block by block
+
+  if ((opt.async > 0 || opt.engine == GRID_SPARSE) &&
+      opt.layout != GRID_TILED)
+    {
+      if (rank == 0)
+        {
+          printf("automaton: %s uses the tiled layout\n",
+                 opt.async > 0 ? "-async" : "-engine sparse");
+        }
+
+      opt.layout = GRID_TILED;
+    }
+  
+  gridmapdir(opt.mapdir);
+  g = gridcreate(LX, LY, opt.layout);
+  k = (g == NULL);
+  MPI_Allreduce(MPI_IN_PLACE, &k, 1, MPI_INT, MPI_MAX, comm);
+
+  if (k)
     {
       if (rank == 0)
         {
-          printf("Usage: automaton <seed>\n");
+          printf("automaton: ERROR, cannot map the grid in <%s>\n",
+                 opt.mapdir);
         }
 
       MPI_Finalize();
       return 1;
     }
 
+  g->x0 = coords[0]*LLX;
+  g->y0 = coords[1]*LLY;
+  rowrand = (float *) malloc(L*sizeof(float));
+  rowcell = (int *) malloc(L*sizeof(int));
+  
+  /*
+   * Non-periodic boundary conditions
+   *
+   * Note that the special rank of MPI_PROC_NULL is a "black hole" for
+   * communications. Using this value for processes off the edges of
+   * the grid means there is no additional logic needed to ensure
+   * processes at the edges do not attempt to send to or receive from
+   * invalid ranks (i.e. rank = -1 and rank = NPROC).
+   *
+   * A full solution would compute neighbours in a Cartesian topology
+   * via MPI_Cart_shift where MPI_PROC_NULL is assigned automatically.
+   */
+
   /*
    *  Update for a fixed number of steps and periodically report progress
    */
@@ -139,260 +333,773 @@ int main(int argc, char *argv[])
     {
       printf("automaton: running on %d process(es)\n", size);
 
+      printf("automaton: process grid %d x %d on %d node(s)",
+             dims[0], dims[1], topo->nnodes);
+
+      if (topo->nodedims[0] > 0)
+        {
+          printf(", node blocks %d x %d\n", topo->nodedims[0], topo->nodedims[1]);
+        }
+      else
+        {
+          printf(", ranks in row-major order\n");
+        }
+
+      printf("automaton: predicted halo bytes per step: network %ld, node %ld, self %ld\n",
+             topo->predicted[TOPO_NETWORK], topo->predicted[TOPO_NODE],
+             topo->predicted[TOPO_SELF]);
+
+      if (opt.tile > 0 && dims[0] == dims[1])
+        {
+          printf("automaton: weak scaling, L = %d for %d x %d cells per process, tiles %d x %d\n",
+                 L, opt.tile, opt.tile, LLX, LLY);
+        }
+      else if (opt.tile > 0)
+        {
+          printf("automaton: weak scaling, L = %d for about %d x %d cells per process, tiles %d x %d on a %d x %d process grid\n",
+                 L, opt.tile, opt.tile, LLX, LLY, dims[0], dims[1]);
+        }
+    }
+
+  /*
+   *  Set the cell density rho (between 0 and 1) of a random start
+   */
+
+  rho = 0.52; // Change rho here
+
+  if (opt.sweep > 0)
+    {
       /*
-       *  Set the cell density rho (between 0 and 1)
+       *  Draw the numbers once; each point of the sweep sets the cells
        */
 
-      rho = 0.52; // Change rho here
+      seed = atoi(argv[1]);
+
+      if (rank == 0)
+        {
+          printf("automaton: L = %d, sweep of rho = %f ... %f, seed = %d, maxstep = %d\n",
+                 L, opt.rholo, opt.rhohi, seed, maxstep);
+        }
 
+      sw = sweepcreate(g, opt.rng, seed, maxstep, comm);
+    }
+  else if (opt.restart != NULL)
+    {
       /*
-       *  Set the random number seed and initialise the generator
+       *  Take the cells, step and parameters from a checkpoint
        */
 
+      if (ckptread(opt.restart, g, &header, comm) != 0)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: ERROR, cannot restart from <%s>\n",
+                     opt.restart);
+            }
+
+          MPI_Finalize();
+          return 1;
+        }
+
+      step0 = header.step;
+      seed = header.seed;
+      rho = header.rho;
+      incells = header.incells;
+
+      if (rank == 0)
+        {
+          printf("automaton: restarting from <%s> at step %d\n",
+                 opt.restart, step0);
+          printf("automaton: L = %d, rho = %f, seed = %d, maxstep = %d\n",
+                 L, rho, seed, maxstep);
+        }
+    }
+  else if (opt.input != NULL)
+    {
+      /*
+       *  Every process reads its own tile of the pattern
+       */
+
+      if (autoread(opt.input, g, comm) != 0)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: ERROR, cannot read a %d x %d pattern from <%s>\n",
+                     L, L, opt.input);
+            }
+
+          MPI_Finalize();
+          return 1;
+        }
+
+      localncell = gridcount(g);
+      MPI_Allreduce(&localncell, &incells, 1, MPI_LONG, MPI_SUM, comm);
+
       seed = atoi(argv[1]);
+      rho = ((double) incells)/((double) L*L);
 
-      printf("automaton: L = %d, rho = %f, seed = %d, maxstep = %d\n",
-             L, rho, seed, maxstep);
+      if (rank == 0)
+        {
+          printf("automaton: L = %d, pattern <%s>, maxstep = %d\n",
+                 L, opt.input, maxstep);
+          printf("automaton: living cells = %ld, actual density = %f\n",
+                 incells, rho);
+        }
+    }
+  else if (opt.rng == RNG_COUNTER)
+    {
+      seed = atoi(argv[1]);
 
-      rinit(seed);
+      if (rank == 0)
+        {
+          printf("automaton: L = %d, rho = %f, seed = %d, maxstep = %d\n",
+                 L, rho, seed, maxstep);
+        }
 
       /*
-       *  Initialise with the fraction of filled cells equal to rho
+       *  Every process draws the numbers of its own cells only: cell
+       *  (i, j) takes number i*L + j of the stream, whatever the
+       *  decomposition
        */
 
-      ncell = 0;
+      rngseed(&gen, RNG_COUNTER, seed);
 
-      for (i=0; i < L; i++)
+      localncell = 0;
+
+      for (i=1; i <= LX; i++)
         {
-          for (j=0; j < L; j++)
+          rng rowgen = gen;
+
+          rngjump(&rowgen, (uint64_t) (g->x0+i-1)*L + g->y0);
+          rngfill(&rowgen, rowrand, LY);
+
+          for (j=0; j < LY; j++)
             {
-              r=uni();
+              rowcell[j] = (rowrand[j] < rho);
+              localncell += rowcell[j];
+            }
 
-              if(r < rho)
-                {
-                  allcell[i][j] = 1;
-                  ncell++;
-                }
-              else
+          gridsetrow(g, i, rowcell);
+        }
+
+      MPI_Allreduce(&localncell, &incells, 1, MPI_LONG, MPI_SUM, comm);
+
+      if (rank == 0)
+        {
+          printf("automaton: rho = %f, living cells = %ld, actual density = %f\n",
+                  rho, incells, ((double) incells)/((double) L*L) );
+        }
+    }
+  else
+    {
+      allcell = (int **) arraymalloc2d(L, L, sizeof(int));
+
+      if (rank == 0)
+        {
+          /*
+           *  Set the random number seed and initialise the generator
+           */
+
+          seed = atoi(argv[1]);
+
+          printf("automaton: L = %d, rho = %f, seed = %d, maxstep = %d\n",
+                 L, rho, seed, maxstep);
+
+          rngseed(&gen, RNG_UNI, seed);
+
+          /*
+           *  Initialise with the fraction of filled cells equal to rho,
+           *  drawing the same UNI sequence as rinit and uni()
+           */
+
+          ncell = 0;
+
+          for (i=0; i < L; i++)
+            {
+              rngfill(&gen, rowrand, L);
+
+              for (j=0; j < L; j++)
                 {
-                  allcell[i][j] = 0;
+                  if(rowrand[j] < rho)
+                    {
+                      allcell[i][j] = 1;
+                      ncell++;
+                    }
+                  else
+                    {
+                      allcell[i][j] = 0;
+                    }
                 }
             }
+
+          printf("automaton: rho = %f, living cells = %ld, actual density = %f\n",
+                  rho, ncell, ((double) ncell)/((double) L*L) );
+          incells = ncell;
+        }
+      /*
+       *   Now broadcast allcell and incells to the every process
+       */
+
+      MPI_Bcast(&incells, 1, MPI_LONG, 0, comm);
+      largebcast(&allcell[0][0], (long) L*L, MPI_INT, 0, comm);
+  
+      /*
+       * Initialise the cell array: copy the local part of allcell to the
+       * centre of the array cell; set the halo values to zero.
+       */
+   
+      for (i=1; i <= LX; i++)
+        {
+          gridsetrow(g, i, &allcell[coords[0]*LLX+i-1][coords[1]*LLY]);
         }
 
-      printf("automaton: rho = %f, living cells = %d, actual density = %f\n",
-              rho, ncell, ((double) ncell)/((double) L*L) );
-      incells = ncell;
+      free(allcell);
     }
+
   /*
-   *   Now broadcast allcell and incells to the every process
+   * Set the boundary condition: dead cells except for the middle two
+   * thirds of the j = 0 and j = L-1 edges
    */
 
-  MPI_Bcast(&incells, 1, MPI_INT, 0, comm);
-  MPI_Bcast(&allcell[0][0], L*L, MPI_INT, 0, comm);
-  
+  gridboundary(g);
+
+  if (opt.engine == GRID_SPARSE) gridsparse(g);
+
   /*
-   * Initialise the cell array: copy the array smallcell to the
-   * centre of the array cell; set the halo values to zero.
+   * Choose how the column halos are sent, by timing every strategy
+   * on this tile shape unless one was requested
    */
-   
-  for (i=1; i <= LX; i++)
+
+  if (opt.halo == HALO_AUTO)
     {
-      for (j=1; j <= LY; j++)
+      if (gridhalotune(g, comm, up, down, left, right, halotimes) == HALO_AUTO)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: halo strategy contiguous (tiled layout)\n");
+            }
+        }
+      else if (rank == 0)
         {
-          cell[i][j] = allcell[coords[0]*LLX+i-1][coords[1]*LLY+j-1];
+          printf("automaton: halo time vector %.2f us, manual %.2f us, pack %.2f us\n",
+                 1.0e6*halotimes[HALO_VECTOR], 1.0e6*halotimes[HALO_MANUAL],
+                 1.0e6*halotimes[HALO_PACK]);
         }
     }
-    
+  else
+    {
+      g->halomode = opt.halo;
+    }
+
+  if (rank == 0 && opt.layout == GRID_ROWMAJOR)
+    {
+      printf("automaton: halo strategy %s\n",
+             g->halomode == HALO_MANUAL ? "manual" :
+             g->halomode == HALO_PACK   ? "pack"   : "vector");
+
+      if (g->kernel != NULL)
+        printf("automaton: update kernel specialised for width %d\n", g->ly);
+      else
+        printf("automaton: generic update kernel for width %d\n", g->ly);
+    }
+
   /*
-   * Set normal boundary condition
+   *  A sweep runs the automaton once per rho and is then done
    */
-   
-  for (i=0; i <= LX+1; i++)
+
+  if (sw != NULL)
     {
-      cell[i][0]    = 0;
-      cell[i][LY+1] = 0;
+      sweepbisect(sw, g, opt.rholo, opt.rhohi, opt.sweep, comm,
+                  up, down, left, right);
+
+      sweepfree(sw);
+      gridfree(g);
+      free(rowrand);
+      free(rowcell);
+      freeLXY();
+      topofree(topo);
+      MPI_Comm_free(&comm);
+      MPI_Finalize();
+
+      return 0;
     }
 
-  for (j=0; j <= LY+1; j++)
+  /*
+   * Snapshot files record the tiles once, so they cannot move
+   */
+
+  if (opt.balance > 0 && opt.snapshot > 0)
     {
-      cell[0][j]    = 0;
-      cell[LX+1][j] = 0;
+      if (rank == 0)
+        {
+          printf("automaton: -balance is off with -snapshot\n");
+        }
+
+      opt.balance = 0;
     }
 
-  int ru = coords[0]*LLX+1; // Lower bound
-  int rb = coords[0]*LLX+LX; // Upper bound
+  if (opt.balance > 0)
+    {
+      bal = balancecreate(opt.balance, step0, &g, cart_comm,
+                          up, down, left, right);
+    }
 
   /*
-   * Set new boundary condition
+   * Follow the fingerprint of the local cells incrementally if we are
+   * looking for cycles
    */
 
-  if (size==1) {
-      for (i=L/6; i <= (5*L)/6; i++){
-        cell[i][L+1] = 1;
-        cell[i][0]   = 1;
-      }
-  }
-  else {
-      if(coords[1]==0){
-          if(ru<L/6&&rb>=L/6){
-              for (j=L/6-ru; j < LX; j++)
-              {
-                cell[j+1][0] = 1;
-              }
-          }
-          if(ru>L/6&&rb<=(5*L)/6){
-              for (j=0; j < LX; j++)
-              {
-                cell[j+1][0] = 1;
-              }
-          }
-          if(ru<(5*L)/6&&rb>(5*L)/6){
-              for (j=0; j < ((5*L)/6)-ru+1; j++)
-              {
-                cell[j+1][0] = 1;
-              }
-          }
-      }
-      if(coords[1]==PROC_COLS-1){
-          if(ru<L/6&&rb>=L/6){
-              for (j=L/6-ru; j < LX; j++)
-              {
-                cell[j+1][LY+1] = 1;
-              }
-          }
-          if(ru>L/6&&rb<=(5*L)/6){
-              for (j=0; j < LX; j++)
-              {
-                cell[j+1][LY+1] = 1;
-              }
-          }
-          if(ru<(5*L)/6&&rb>(5*L)/6){
-              for (j=0; j < ((5*L)/6)-ru+1; j++)
-              {
-                cell[j+1][LY+1] = 1;
-              }
-          }
-      }
-  }
+  if (opt.cycle > 0)
+    {
+      cyc = cyclecreate(opt.cycle, opt.cycleperiod);
+      gridtrack(g);
+    }
+
+  if (opt.verify > 0)
+    {
+      ver = verifycreate(opt.verify, opt.trace, opt.golden, rank);
+
+      // after a restart the cells are no longer the initial ones
+
+      localncell = gridcount(g);
+      MPI_Allreduce(&localncell, &ncell, 1, MPI_LONG, MPI_SUM, comm);
+
+      verifystep(ver, g, step0, ncell, comm, rank);
+    }
+
+  if (opt.checkpoint > 0)
+    {
+      ckpt = ckptcreate(opt.ckptfile, g);
+    }
+
+  if (opt.snapshot > 0)
+    {
+      snap = snapcreate(opt.snapfile, opt.snapformat, opt.snapshot, step0,
+                        g, comm);
+
+      if (snap == NULL)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: ERROR, cannot open <%s>\n", opt.snapfile);
+            }
+          MPI_Finalize();
+          return 1;
+        }
+
+      snapstep(snap, g, step0);
+    }
+
+  if (opt.stats > 0)
+    {
+      sta = statscreate(opt.statsfile, opt.stats, step0, g, comm, rank);
+
+      if (sta == NULL)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: ERROR, cannot open <%s>\n", opt.statsfile);
+            }
+          MPI_Finalize();
+          return 1;
+        }
+    }
+
+  if (opt.cluster > 0)
+    {
+      clu = clustercreate(opt.cluster, g);
+
+      if (clusterstep(clu, g, step0, cart_comm, up, down, left, right) &&
+          rank == 0)
+        {
+          printf("automaton: step %d has %ld clusters, largest %ld cells, %s\n",
+                 step0, clu->nclusters, clu->largest,
+                 clu->spanning ? "spanning" : "not spanning");
+        }
+    }
+
+  for (s=0; s < 4; s++)
+    {
+      g->halobytes[s] = 0;
+    }
+
   MPI_Barrier(comm);
-  
-  MPI_Request requests[8]; // Requests for Non-blocking communication
-  MPI_Status statuses[8]; // Statuses for Non-blocking communication
+
+  if (opt.metrics > 0)
+    {
+      met = metricscreate(opt.metricsfile, opt.metricsformat, opt.metrics,
+                          step0, comm);
+
+      if (met == NULL)
+        {
+          if (rank == 0)
+            {
+              printf("automaton: ERROR, cannot open <%s>\n", opt.metricsfile);
+            }
+          MPI_Finalize();
+          return 1;
+        }
+    }
   
   // Start timing
   if (rank==0){
       tstart = MPI_Wtime();
   }
   
-  int step_count = 0; // The number of steps
+  int step_count = step0; // The number of steps
+
+  if (opt.async > 0)
+    {
+      lag = lagcreate(opt.async);
+    }
+
+  levelfreq[0] = opt.verify;
+  levelfreq[1] = opt.cluster;
+  levelfreq[2] = opt.checkpoint;
+  levelfreq[3] = opt.snapshot;
+  levelfreq[4] = opt.balance;
   
-  for (step = 1; step <= maxstep; step++)
+  for (step = step0+1; step <= maxstep; step++)
     {
       /*
        *  Swap halos up and down
        */
 
       /*
-       * Communications is done using the sendrecv routine; a full
-       * solution would use non-blocking communications (e.g. using
-       * some suitable combination of issend and/or irecv)
+       * Communications is done using non-blocking synchronous sends
+       * and receives; in the tiled layout every message is contiguous
        */
-        MPI_Datatype column_type; // New data type for halo sweap
-        MPI_Type_vector(LX, 1, LY + 2, MPI_INT, &column_type);
-        MPI_Type_commit(&column_type);
-       
-       // Communications between neighbor blocks
-        MPI_Issend(&cell[1][1], LY, MPI_INT, up, tag, comm, &requests[0]);
-        MPI_Irecv(&cell[LX+1][1], LY, MPI_INT, down, tag, comm, &requests[1]);
-        MPI_Issend(&cell[LX][1], LY, MPI_INT, down, tag, comm, &requests[2]);
-        MPI_Irecv(&cell[0][1], LY, MPI_INT, up, tag, comm, &requests[3]);
-        
-        MPI_Issend(&cell[1][1], 1, column_type, left, tag, comm, &requests[4]);
-        MPI_Irecv(&cell[1][LY+1], 1, column_type, right, tag, comm, &requests[5]);
-        MPI_Issend(&cell[1][LY], 1, column_type, right, tag, comm, &requests[6]);
-        MPI_Irecv(&cell[1][0], 1, column_type, left, tag, comm, &requests[7]);
-        
-        MPI_Waitall(8, requests, statuses);
-        
-      for (i=1; i<=LX; i++)
+
+      /*
+       * With -async the inner blocks are updated while the halos are
+       * in flight and each edge block as soon as its halos arrive, and
+       * the global count is summed in the background
+       */
+
+      if (lag != NULL && opt.ahead > 0)
         {
-          for (j=1; j<=LY; j++)
+          // the blocks are level on the next step that is read
+
+          cap = maxstep;
+
+          for (k=0; k < 5; k++)
             {
-              /*
-               * Set neigh[i][j] to be the sum of cell[i][j] plus its
-               * four nearest neighbours
-               */
-
-              neigh[i][j] =   cell[i][j] 
-                            + cell[i][j+1]
-                            + cell[i][j-1]
-                            + cell[i+1][j]
-                            + cell[i-1][j];
+              if (levelfreq[k] > 0 &&
+                  (step + levelfreq[k] - 1)/levelfreq[k]*levelfreq[k] < cap)
+                {
+                  cap = (step + levelfreq[k] - 1)/levelfreq[k]*levelfreq[k];
+                }
             }
-        }
 
-      localncell = 0;
+          localncell = gridstepahead(g, comm, up, down, left, right, step,
+                                     opt.ahead, cap);
+        }
+      else if (lag != NULL)
+        {
+          localncell = gridstepasync(g, comm, up, down, left, right);
+        }
 
-      for (i=1; i<=LX; i++)
+      if (lag != NULL)
         {
-          for (j=1; j<=LY; j++)
-            {
-              /*
-               * Udate based on number of neighbours
-               */
 
-              if (neigh[i][j] == 5 || neigh[i][j] == 4 || neigh[i][j] == 2)
-                {
-                  cell[i][j] = 1;
-                  localncell++;
-                }
-              else
-                {
-                  cell[i][j] = 0;
-                }
+          if (met != NULL) metricsphase(met, METRIC_UPDATE);
+
+          lagpush(lag, step, localncell, comm);
+
+          // the checksums and statistics need this step's count now
+
+          if (sta != NULL || (ver != NULL && step % opt.verify == 0))
+            {
+              MPI_Allreduce(&localncell, &ncell, 1, MPI_LONG, MPI_SUM, comm);
             }
         }
+      else
+        {
+          gridhalo(g, comm, up, down, left, right);
+
+          if (met != NULL) metricsphase(met, METRIC_HALO);
+
+          localncell = gridstep(g);
+
+          if (met != NULL) metricsphase(met, METRIC_UPDATE);
+
+          /*
+           *  Compute the global changes on rank 0
+           */
+
+          MPI_Reduce(&localncell, &ncell, 1, MPI_LONG, MPI_SUM, 0, comm);
+          /*
+           *  Report progress every now and then
+           */
+          MPI_Bcast(&ncell, 1, MPI_LONG, 0, comm);
+        }
 
       /*
-       *  Compute the global changes on rank 0
+       *  Metrics take the place of the progress lines
        */
 
-      MPI_Reduce(&localncell, &ncell, 1, MPI_INT, MPI_SUM, 0, comm);
+      if (met != NULL)
+        {
+          metricsphase(met, METRIC_REDUCE);
+          metricsstep(met, g, step, localncell);
+        }
+
+      if (ver != NULL) verifystep(ver, g, step, ncell, comm, rank);
+
+      if (sta != NULL) statsstep(sta, g, step, ncell, comm, rank);
+
       /*
-       *  Report progress every now and then
+       *  Label the clusters every now and then
        */
-      MPI_Bcast(&ncell, 1, MPI_INT, 0, comm);
+
+      if (clu != NULL &&
+          clusterstep(clu, g, step, cart_comm, up, down, left, right) &&
+          rank == 0)
+        {
+          printf("automaton: step %d has %ld clusters, largest %ld cells, %s\n",
+                 step, clu->nclusters, clu->largest,
+                 clu->spanning ? "spanning" : "not spanning");
+        }
       
-      if (step % printfreq == 0)
+      /*
+       * The lagged counts arrive on the same step on every process, so
+       * they all stop together, up to opt.async steps late
+       */
+
+      if (lag != NULL)
         {
-          if (rank == 0)
+          stop = 0;
+
+          while (lagpop(lag, &donestep, &donecell, 0))
             {
-              printf("automaton: number of living cells on step %d is %d\n",
+              if (donestep % printfreq == 0 && rank == 0 && met == NULL)
+                {
+                  printf("automaton: number of living cells on step %ld is %ld\n",
+                         donestep, donecell);
+                }
+
+              if (donecell<(3*incells)/4||donecell>(4*incells)/3) stop = 1;
+            }
+
+          if (stop) {
+              if (rank==0) {
+                  printf("Terminate at step %d with %ld living cells (step %ld)!\n",
+                         step, donecell, donestep);
+                  step_count = step;
+              }
+
+              // run the blocks that are ahead and the rest level
+
+              if (opt.ahead > 0)
+                {
+                  cap = (step + opt.ahead < cap) ? step + opt.ahead : cap;
+
+                  while (step < cap)
+                    {
+                      step++;
+                      gridstepahead(g, comm, up, down, left, right, step,
+                                    opt.ahead, cap);
+                    }
+
+                  if (rank == 0)
+                    {
+                      printf("automaton: blocks brought level at step %d\n", step);
+                      step_count = step;
+                    }
+                }
+              break;
+          }
+        }
+      else if (step % printfreq == 0)
+        {
+          if (rank == 0 && met == NULL)
+            {
+              printf("automaton: number of living cells on step %d is %ld\n",
                      step, ncell);
             }
         }
         
       // Special termination conditions
-      if (ncell<(3*incells)/4||ncell>(4*incells)/3) {
+      if (lag == NULL && (ncell<(3*incells)/4||ncell>(4*incells)/3)) {
+          if (rank==0) {
+              printf("Terminate at step %d with %ld living cells!\n", step, ncell);
+              step_count = step;
+          }
+          break;
+      }
+
+      // Stop once the automaton repeats itself
+      if (cyc != NULL && cyclepush(cyc, step, g->hash, comm) != 0) {
           if (rank==0) {
-              printf("Terminate at step %d with %d living cells!\n", step, ncell);
+              printf("Terminate at step %d: period %d cycle reached by step %ld\n",
+                     step, cyc->period, cyc->start);
               step_count = step;
           }
           break;
       }
       step_count = step;
+
+      /*
+       *  Start a checkpoint; it is written while we carry on, and
+       *  marked valid once it is on disk
+       */
+
+      if (ckpt != NULL) ckptpoll(ckpt, comm);
+
+      if (ckpt != NULL && step % opt.checkpoint == 0)
+        {
+          header.l = L;
+          header.step = step;
+          header.seed = seed;
+          header.rule = RULE;
+          header.rho = rho;
+          header.incells = incells;
+
+          ckptwrite(ckpt, g, &header, comm);
+        }
+
+      /*
+       *  Hand a frame to the snapshot writer
+       */
+
+      if (snap != NULL) snapstep(snap, g, step);
+
+      /*
+       *  Move the tile boundaries if the update times have drifted
+       *  apart; the arrays of the old tile are rebuilt
+       */
+
+      if (bal != NULL && balancestep(bal, &g, step, cart_comm))
+        {
+          if (ckpt != NULL) ckptresize(ckpt, g, comm);
+
+          if (clu != NULL)
+            {
+              clusterfree(clu);
+              clu = clustercreate(opt.cluster, g);
+            }
+
+          if (rank == 0)
+            {
+              printf("automaton: step %d rebalanced, moving up to %ld cells, slowest update %f -> %f ms (predicted)\n",
+                     step, bal->moved,
+                     1000*bal->before, 1000*bal->after);
+            }
+        }
+
+      if (met != NULL) metricsphase(met, METRIC_OUTPUT);
     }
     
+  /*
+   * Report the counts still outstanding, unless we stopped early
+   */
+
+  if (lag != NULL)
+    {
+      while (!stop && lagpop(lag, &donestep, &donecell, 1))
+        {
+          if (donestep % printfreq == 0 && rank == 0 && met == NULL)
+            {
+              printf("automaton: number of living cells on step %ld is %ld\n",
+                     donestep, donecell);
+            }
+        }
+
+      lagfree(lag);
+    }
+
   MPI_Barrier(comm);
   
   // End timing
   if(rank==0){
     tend = MPI_Wtime();
     printf("L=%d, rho=%f, T=%d, ms=%d, seed=%d\n", L, rho, size, maxstep, seed);
-    printf("Time cost each step: %f ms, total step: %d\n", 1000*(tend-tstart)/step_count, step_count);
+    printf("Time cost each step: %f ms, total step: %d\n", 1000*(tend-tstart)/(step_count-step0), step_count);
   }
 
+  if (met != NULL)
+    {
+      if (rank == 0 && met->nwait > 0)
+        {
+          printf("automaton: metrics waited for a sample %d times\n", met->nwait);
+        }
+
+      metricsfree(met, g, step_count, localncell);
+    }
+
+  /*
+   * Halo bytes actually sent, by link class
+   */
+
+  neighbour[STRIP_UP] = up;
+  neighbour[STRIP_DOWN] = down;
+  neighbour[STRIP_LEFT] = left;
+  neighbour[STRIP_RIGHT] = right;
+
+  for (k=0; k < TOPO_CLASSES; k++)
+    {
+      halobytes[k] = 0;
+    }
+
+  for (s=0; s < 4; s++)
+    {
+      k = topoclass(topo, rank, neighbour[s]);
+      if (k >= 0) halobytes[k] += g->halobytes[s];
+    }
+
+  MPI_Allreduce(MPI_IN_PLACE, halobytes, TOPO_CLASSES, MPI_LONG, MPI_SUM, comm);
+
+  if (rank == 0 && step_count > step0)
+    {
+      printf("automaton: measured halo bytes per step: network %ld, node %ld, self %ld\n",
+             halobytes[TOPO_NETWORK]/(step_count-step0),
+             halobytes[TOPO_NODE]/(step_count-step0),
+             halobytes[TOPO_SELF]/(step_count-step0));
+
+      // only sparse halos and moved tile boundaries send other amounts
+
+      for (k=0; k < TOPO_CLASSES; k++)
+        {
+          if (halobytes[k] != topo->predicted[k]*(step_count-step0) &&
+              opt.engine != GRID_SPARSE && (bal == NULL || bal->nmove == 0))
+            {
+              printf("automaton: WARNING, measured halo bytes differ from the prediction\n");
+              break;
+            }
+        }
+    }
+
+  if (opt.engine == GRID_SPARSE)
+    {
+      long updates[2] = {g->nsparse, g->nupdate};
+
+      MPI_Allreduce(MPI_IN_PLACE, updates, 2, MPI_LONG, MPI_SUM, comm);
+
+      if (rank == 0 && updates[1] > 0)
+        {
+          printf("automaton: %.1f%% of block updates from lists of living cells\n",
+                 100.0*updates[0]/updates[1]);
+        }
+    }
+
+  if (bal != NULL && rank == 0)
+    {
+      printf("automaton: %d rebalances, %f ms moving cells\n",
+             bal->nmove, 1000*bal->tspent);
+    }
+
+  if (snap != NULL && rank == 0)
+    {
+      printf("automaton: %ld snapshots, copy %f ms, waiting for the writer %f ms (%d times)\n",
+             snap->nframes, 1000*snap->tcopy, 1000*snap->twait, snap->nwait);
+
+      if (opt.snapformat == SNAP_RLE && snap->nframes > 0)
+        {
+          printf("automaton: snapshots compressed to %.1f%% of %ld bytes per frame\n",
+                 100.0*snap->bytes/((double) snap->nframes*L*L), (long) L*L);
+        }
+    }
+
   // I would recommend stopping the MPI timer here - remember to
   // synchronise the processes as described in the MPP exercise sheet.
   //
@@ -408,61 +1115,79 @@ int main(int argc, char *argv[])
   // number of steps and not by maxstep.
 
   /*
-   *  Copy the centre of cell, excluding the halos, into allcell
+   *  A window or a coarse image only needs the part of the grid that
+   *  is written, so the whole grid is not gathered
    */
-  
-  for (i=1; i<=LX; i++)
+
+  if (opt.image == IMAGE_WINDOW)
     {
-      for (j=1; j<=LY; j++)
-        {
-          smallcell[i-1][j-1] = cell[i][j];
-        }
+      viewwindow(g, window, "cell.pbm", comm);
     }
-
-  for (i=0; i < L; i++)
+  else if (opt.image == IMAGE_COARSE)
     {
-      for (j=0; j < L; j++)
-        {
-          tmpcell[i][j] = 0;
-        }
+      viewcoarse(g, opt.coarse, "cell.pgm", comm);
     }
-    
-  for (i=1; i <= LX; i++)
+  else
     {
-      for (j=1; j <= LY; j++)
+      allcell = (int **) arraymalloc2d(L, L, sizeof(int));
+      tmpcell = (int **) arraymalloc2d(L, L, sizeof(int));
+
+      for (i=0; i < L; i++)
         {
-          tmpcell[coords[0]*LLX+i-1][coords[1]*LLY+j-1] = smallcell[i-1][j-1];
+          for (j=0; j < L; j++)
+            {
+              tmpcell[i][j] = 0;
+            }
         }
-    }
 
-  /*
-   *  Now gather the array smallcell back to allcell
-   */
-  MPI_Reduce(&tmpcell[0][0], &allcell[0][0], L*L, MPI_INT, MPI_SUM, 0, comm); 
+      /*
+       *  Copy the centre of cell, excluding the halos, into tmpcell
+       */
 
-  /*
-   *  Write the cells to the file "cell.pbm" from rank 0
-   */
+      for (i=1; i <= g->lx; i++)
+        {
+          gridgetrow(g, i, &tmpcell[g->x0+i-1][g->y0]);
+        }
 
-  if (rank == 0)
-    {
-      //autowrite("cell.pbm", allcell);
-      autowritedynamic("cell.pbm", allcell, L);
-      
+      /*
+       *  Now gather the local cells back to allcell
+       */
+      largereduce(&tmpcell[0][0], &allcell[0][0], (long) L*L, MPI_INT, MPI_SUM, 0, comm);
+
+      /*
+       *  Write the cells to the file "cell.pbm" from rank 0
+       */
+
+      if (rank == 0)
+        {
+          //autowrite("cell.pbm", allcell);
+          autowritedynamic("cell.pbm", allcell, L);
+        }
+
+      free(tmpcell);
+      free(allcell);
     }
-    
+
+
   // Free all the memory
-  free(cell);
-  free(neigh);
-  free(allcell);
-  free(tmpcell);
-  free(smallcell);
+  if (ckpt != NULL) ckptfree(ckpt, comm);
+  if (snap != NULL) snapfree(snap);
+  if (clu != NULL) clusterfree(clu);
+  if (sta != NULL) statsfree(sta, g, comm, rank);
+  if (bal != NULL) balancefree(bal);
+  gridfree(g);
+  if (cyc != NULL) cyclefree(cyc);
+  if (ver != NULL) nbad = verifyfree(ver, rank);
+  free(rowrand);
+  free(rowcell);
   freeLXY();
+  topofree(topo);
+  MPI_Comm_free(&comm);
   /*
    * Finalise MPI before finishing
    */
 
   MPI_Finalize();
 
-  return 0;
+  return (nbad == 0) ? 0 : 1;
 }
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "autoread.h"
+#include "largecount.h"
+
+/*
+ *  Functions to read a pattern into the grid in parallel. Each process
+ *  reads only the bytes of its own tile through an MPI-IO file view.
+ *
+ *  PBM files are read the way autowritedynamic writes them: cell (i, j)
+ *  is pixel i of line L-1-j, and living cells are white (0).
+ */
+
+/*
+ *  Parse a PBM header on rank 0: format, size and offset of the
+ *  pixels. Returns 1 if the file is not a PBM file.
+ */
+
+static int pbmheader(FILE *fp, int *format, int *w, int *h, long *offset)
+{
+  int c, n, val[2];
+
+  if (fgetc(fp) != 'P') return 1;
+
+  c = fgetc(fp);
+  if (c != '1' && c != '4') return 1;
+
+  *format = (c == '1') ? READ_P1 : READ_P4;
+
+  for (n=0; n < 2; n++)
+    {
+      c = fgetc(fp);
+
+      while (c == '#' || isspace(c))
+        {
+          if (c == '#')
+            {
+              while (c != '\n' && c != EOF) c = fgetc(fp);
+            }
+          c = fgetc(fp);
+        }
+
+      if (!isdigit(c)) return 1;
+
+      val[n] = 0;
+
+      while (isdigit(c))
+        {
+          val[n] = 10*val[n] + c - '0';
+          c = fgetc(fp);
+        }
+    }
+
+  // a single whitespace character separates the header from the data
+
+  *w = val[0];
+  *h = val[1];
+  *offset = ftell(fp);
+
+  return 0;
+}
+
+/*
+ *  Fallback for P1 files that are not laid out as autowritedynamic
+ *  writes them: rank 0 parses the whole file and broadcasts it
+ */
+
+static void p1serial(const char *filename, long offset, grid *g,
+                     unsigned char *buf, MPI_Comm comm)
+{
+  unsigned char *all;
+  FILE *fp;
+  long i, j, n;
+  int c, rank;
+
+  MPI_Comm_rank(comm, &rank);
+
+  all = (unsigned char *) malloc((size_t) L*L);
+
+  if (rank == 0)
+    {
+      printf("autoread: irregular P1 file, parsing it on rank 0\n");
+
+      fp = fopen(filename, "r");
+      fseek(fp, offset, SEEK_SET);
+
+      n = 0;
+
+      while (n < (long) L*L && (c = fgetc(fp)) != EOF)
+        {
+          if (c == '0' || c == '1')
+            {
+              j = L-1 - n/L;
+              i = n%L;
+              all[i*L+j] = (c == '0');
+              n++;
+            }
+        }
+
+      fclose(fp);
+    }
+
+  largebcast(all, (long) L*L, MPI_UNSIGNED_CHAR, 0, comm);
+
+  for (i=0; i < g->lx; i++)
+    {
+      memcpy(buf + i*g->ly, all + (g->x0+i)*L + g->y0, g->ly);
+    }
+
+  free(all);
+}
+
+/*
+ *  Side of the square pattern in the file, from the PBM header or the
+ *  size of a raw file, or 0 if it is not square or cannot be opened.
+ *  Only rank 0 looks at the file. Collective.
+ */
+
+int autosize(const char *filename, MPI_Comm comm)
+{
+  FILE *fp;
+  long offset, size;
+  int rank, format, w, h, l;
+
+  MPI_Comm_rank(comm, &rank);
+
+  l = 0;
+
+  if (rank == 0 && (fp = fopen(filename, "r")) != NULL)
+    {
+      if (pbmheader(fp, &format, &w, &h, &offset) == 0)
+        {
+          if (w == h) l = w;
+        }
+      else
+        {
+          fseek(fp, 0, SEEK_END);
+          size = ftell(fp);
+
+          while ((long) l*l < size) l++;
+          if ((long) l*l != size) l = 0;
+        }
+
+      fclose(fp);
+    }
+
+  MPI_Bcast(&l, 1, MPI_INT, 0, comm);
+
+  return l;
+}
+
+/*
+ *  Read the file into the interior of the grid. The format is taken
+ *  from the file itself: P1 or P4 PBM, otherwise raw bytes. Collective.
+ *  Returns 0 on success and 1 if the file cannot be read or is not of
+ *  size L x L.
+ */
+
+int autoread(const char *filename, grid *g, MPI_Comm comm)
+{
+  MPI_File fh;
+  MPI_Offset filesize;
+  MPI_Datatype filetype, big;
+  unsigned char *buf, *pix;
+  FILE *fp;
+  long offset, k, n;
+  int rank, i, j, b, rowbytes, count;
+  int info[4]; // format, width, height, error
+  MPI_Offset disp;
+
+  MPI_Comm_rank(comm, &rank);
+
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)
+      != MPI_SUCCESS)
+    {
+      return 1;
+    }
+
+  MPI_File_get_size(fh, &filesize);
+
+  /*
+   *  Only the header is looked at on rank 0
+   */
+
+  if (rank == 0)
+    {
+      info[3] = 0;
+      fp = fopen(filename, "r");
+
+      if (fp == NULL || pbmheader(fp, &info[0], &info[1], &info[2], &offset))
+        {
+          info[0] = READ_RAW;
+          info[1] = info[2] = L;
+          offset = 0;
+          if (filesize != (MPI_Offset) L*L) info[3] = 1;
+        }
+
+      if (fp != NULL) fclose(fp);
+      if (info[1] != L || info[2] != L) info[3] = 1;
+
+      disp = offset;
+    }
+
+  MPI_Bcast(info, 4, MPI_INT, 0, comm);
+  MPI_Bcast(&disp, 1, MPI_OFFSET, 0, comm);
+
+  if (info[3] != 0)
+    {
+      MPI_File_close(&fh);
+      return 1;
+    }
+
+  buf = (unsigned char *) malloc((size_t) g->lx*g->ly);
+
+  if (info[0] == READ_RAW)
+    {
+      filetype = gridfiletype(g, MPI_UNSIGNED_CHAR);
+      MPI_File_set_view(fh, 0, MPI_UNSIGNED_CHAR, filetype, "native",
+                        MPI_INFO_NULL);
+      n = (long) g->lx*g->ly;
+      count = largetype(n, MPI_UNSIGNED_CHAR, &big);
+      MPI_File_read_all(fh, buf, count, big, MPI_STATUS_IGNORE);
+      largefree(&big, MPI_UNSIGNED_CHAR);
+      MPI_Type_free(&filetype);
+
+      for (k=0; k < n; k++) buf[k] = (buf[k] != 0);
+    }
+  else
+    {
+      int sizes[2], subsizes[2], starts[2];
+
+      /*
+       *  Our tile is lines L-y0-ly ... L-y0-1 and pixels x0 ... x0+lx-1.
+       *  In a P1 file from autowritedynamic every pixel is a digit and a
+       *  separator, so each line is 2L bytes; in P4 it is ceil(L/8).
+       */
+
+      if (info[0] == READ_P1)
+        {
+          if (filesize != disp + 2*(MPI_Offset) L*L)
+            {
+              p1serial(filename, (long) disp, g, buf, comm);
+              MPI_File_close(&fh);
+              gridsetbytes(g, buf);
+              free(buf);
+              return 0;
+            }
+
+          rowbytes = 2*L;
+          starts[1] = 2*g->x0;
+          subsizes[1] = 2*g->lx;
+        }
+      else
+        {
+          rowbytes = (L+7)/8;
+          starts[1] = g->x0/8;
+          subsizes[1] = (g->x0+g->lx-1)/8 - g->x0/8 + 1;
+        }
+
+      sizes[0] = L;
+      sizes[1] = rowbytes;
+      subsizes[0] = g->ly;
+      starts[0] = L - g->y0 - g->ly;
+
+      MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+                               MPI_UNSIGNED_CHAR, &filetype);
+      MPI_Type_commit(&filetype);
+
+      pix = (unsigned char *) malloc((size_t) subsizes[0]*subsizes[1]);
+
+      MPI_File_set_view(fh, disp, MPI_UNSIGNED_CHAR, filetype, "native",
+                        MPI_INFO_NULL);
+      count = largetype((long) subsizes[0]*subsizes[1], MPI_UNSIGNED_CHAR,
+                        &big);
+      MPI_File_read_all(fh, pix, count, big, MPI_STATUS_IGNORE);
+      largefree(&big, MPI_UNSIGNED_CHAR);
+      MPI_Type_free(&filetype);
+
+      // line ly-1-j of pix holds column j of the tile; white is alive
+
+      for (i=0; i < g->lx; i++)
+        {
+          for (j=0; j < g->ly; j++)
+            {
+              unsigned char *line = pix + (size_t) (g->ly-1-j)*subsizes[1];
+
+              if (info[0] == READ_P1)
+                {
+                  buf[(size_t) i*g->ly+j] = (line[2*i] == '0');
+                }
+              else
+                {
+                  b = g->x0 + i - 8*(g->x0/8);
+                  buf[(size_t) i*g->ly+j] = !((line[b/8] >> (7 - b%8)) & 1);
+                }
+            }
+        }
+
+      free(pix);
+    }
+
+  MPI_File_close(&fh);
+
+  gridsetbytes(g, buf);
+  free(buf);
+
+  return 0;
+}
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "balance.h"
+
+/*
+ *  Global position of the first cell of segment k of the split n
+ */
+
+static int origin(const int *n, int k)
+{
+  int i, x = 0;
+
+  for (i=0; i < k; i++)
+    {
+      x += n[i];
+    }
+
+  return x;
+}
+
+/*
+ *  Tile (x0, y0, lx, ly) of process row px and column py
+ */
+
+static void tile(const int *nx, const int *ny, int px, int py, int *t)
+{
+  t[0] = origin(nx, px);
+  t[1] = origin(ny, py);
+  t[2] = nx[px];
+  t[3] = ny[py];
+}
+
+/*
+ *  Overlap o of tiles a and b; returns the number of cells in it
+ */
+
+static long intersect(const int *a, const int *b, int *o)
+{
+  int hi;
+
+  o[0] = (a[0] > b[0]) ? a[0] : b[0];
+  o[1] = (a[1] > b[1]) ? a[1] : b[1];
+
+  hi = (a[0]+a[2] < b[0]+b[2]) ? a[0]+a[2] : b[0]+b[2];
+  o[2] = hi - o[0];
+  hi = (a[1]+a[3] < b[1]+b[3]) ? a[1]+a[3] : b[1]+b[3];
+  o[3] = hi - o[1];
+
+  if (o[2] <= 0 || o[3] <= 0) return 0;
+
+  return (long) o[2]*o[3];
+}
+
+/*
+ *  Copy the cells of tile o from src, holding tile s row-major, to
+ *  dst, holding tile d. Ints and unsigned ints alike.
+ */
+
+static void copytile(const int *o, void *dst, const int *d,
+                     const void *src, const int *s)
+{
+  int i;
+
+  for (i=0; i < o[2]; i++)
+    {
+      memcpy((int *) dst + (size_t) (o[0]-d[0]+i)*d[3] + o[1]-d[1],
+             (const int *) src + (size_t) (o[0]-s[0]+i)*s[3] + o[1]-s[1],
+             o[3]*sizeof(int));
+    }
+}
+
+/*
+ *  New split of L into n segments, each taking the same time if the
+ *  time per row (or column) of segment k stays t[k]/old[k]
+ */
+
+static void split(const int *old, const double *t, int n, int *new)
+{
+  double *w, sum, acc;
+  int k, m, end, prev;
+
+  memcpy(new, old, n*sizeof(int));
+
+  if (n*BALANCEMIN > L) return;
+
+  w = (double *) malloc(n*sizeof(double));
+  sum = 0;
+
+  for (k=0; k < n; k++)
+    {
+      if (t[k] <= 0)
+        {
+          free(w);
+          return;
+        }
+
+      w[k] = old[k]/t[k];
+      sum += w[k];
+    }
+
+  acc = 0;
+  prev = 0;
+
+  for (k=0; k < n-1; k++)
+    {
+      acc += w[k];
+      end = (int) (L*acc/sum + 0.5);
+      new[k] = end - prev;
+      prev = end;
+    }
+
+  new[n-1] = L - prev;
+
+  // keep every segment at least BALANCEMIN wide, taking from the widest
+
+  for (k=0; k < n; k++)
+    {
+      while (new[k] < BALANCEMIN)
+        {
+          for (m=0, end=0; end < n; end++)
+            {
+              if (new[end] > new[m]) m = end;
+            }
+
+          new[m]--;
+          new[k]++;
+        }
+    }
+
+  free(w);
+}
+
+/*
+ *  Move the cells, and the flip counts if any, to the tiles of the new
+ *  split newx x newy and return the new grid; g is freed. Every
+ *  process sends each other process the part of its old tile in their
+ *  new one. Collective.
+ */
+
+static grid *migrate(grid *g, const int *newx, const int *newy,
+                     const int *rowof, const int *colof, MPI_Comm comm)
+{
+  grid *ng;
+  MPI_Request *request;
+  int rank, size, r, i, nreq;
+  int me[4], to[4], o[4], ot[4];
+  int *cells, *newcells, **buf;
+  unsigned int **flipbuf;
+  long n;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  tile(LXX, LYY, rowof[rank], colof[rank], me);
+  tile(newx, newy, rowof[rank], colof[rank], to);
+
+  ng = gridcreate(to[2], to[3], g->layout);
+  ng->x0 = to[0];
+  ng->y0 = to[1];
+  ng->halomode = g->halomode;
+  memcpy(ng->halobytes, g->halobytes, sizeof(g->halobytes));
+
+  if (g->flips != NULL) gridflips(ng);
+  if (g->nlive != NULL) gridsparse(ng);
+
+  ng->nsparse = g->nsparse;
+  ng->nupdate = g->nupdate;
+
+  cells = (int *) malloc((size_t) me[2]*me[3]*sizeof(int));
+  newcells = (int *) malloc((size_t) to[2]*to[3]*sizeof(int));
+
+  for (i=1; i <= g->lx; i++)
+    {
+      gridgetrow(g, i, cells + (size_t) (i-1)*g->ly);
+    }
+
+  buf = (int **) calloc(2*size, sizeof(int *));
+  flipbuf = (unsigned int **) calloc(2*size, sizeof(unsigned int *));
+  request = (MPI_Request *) malloc(4*size*sizeof(MPI_Request));
+  nreq = 0;
+
+  /*
+   *  Receive the parts of the new tile held by others, send the parts
+   *  of the old tile others now hold, and keep our own
+   */
+
+  for (r=0; r < size; r++)
+    {
+      if (r == rank) continue;
+
+      tile(LXX, LYY, rowof[r], colof[r], ot);
+
+      if ((n = intersect(to, ot, o)) == 0) continue;
+
+      buf[r] = (int *) malloc(n*sizeof(int));
+      MPI_Irecv(buf[r], n, MPI_INT, r, BALANCETAG, comm, &request[nreq++]);
+
+      if (g->flips != NULL)
+        {
+          flipbuf[r] = (unsigned int *) malloc(n*sizeof(unsigned int));
+          MPI_Irecv(flipbuf[r], n, MPI_UNSIGNED, r, BALANCETAG+1, comm,
+                    &request[nreq++]);
+        }
+    }
+
+  for (r=0; r < size; r++)
+    {
+      if (r == rank) continue;
+
+      tile(newx, newy, rowof[r], colof[r], ot);
+
+      if ((n = intersect(me, ot, o)) == 0) continue;
+
+      buf[size+r] = (int *) malloc(n*sizeof(int));
+      copytile(o, buf[size+r], o, cells, me);
+      MPI_Isend(buf[size+r], n, MPI_INT, r, BALANCETAG, comm,
+                &request[nreq++]);
+
+      if (g->flips != NULL)
+        {
+          flipbuf[size+r] = (unsigned int *) malloc(n*sizeof(unsigned int));
+          copytile(o, flipbuf[size+r], o, g->flips, me);
+          MPI_Isend(flipbuf[size+r], n, MPI_UNSIGNED, r, BALANCETAG+1, comm,
+                    &request[nreq++]);
+        }
+    }
+
+  if (intersect(to, me, o) != 0)
+    {
+      copytile(o, newcells, to, cells, me);
+      if (g->flips != NULL) copytile(o, ng->flips, to, g->flips, me);
+    }
+
+  MPI_Waitall(nreq, request, MPI_STATUSES_IGNORE);
+
+  for (r=0; r < size; r++)
+    {
+      if (buf[r] == NULL) continue;
+
+      tile(LXX, LYY, rowof[r], colof[r], ot);
+      intersect(to, ot, o);
+
+      copytile(o, newcells, to, buf[r], o);
+      if (g->flips != NULL) copytile(o, ng->flips, to, flipbuf[r], o);
+    }
+
+  for (i=1; i <= ng->lx; i++)
+    {
+      gridsetrow(ng, i, newcells + (size_t) (i-1)*ng->ly);
+    }
+
+  gridboundary(ng);
+
+  if (g->track) gridtrack(ng);
+
+  for (r=0; r < 2*size; r++)
+    {
+      free(buf[r]);
+      free(flipbuf[r]);
+    }
+
+  free(buf);
+  free(flipbuf);
+  free(request);
+  free(cells);
+  free(newcells);
+  gridfree(g);
+
+  return ng;
+}
+
+/*
+ *  Predict the cost of a migration from a rebuild of the grid that
+ *  moves nothing and from HALOTRIALS halo exchanges, both timed on the
+ *  slowest process. comm must be the Cartesian communicator of the
+ *  process grid. Collective.
+ */
+
+balance *balancecreate(int freq, long step0, grid **g, MPI_Comm comm,
+                       int up, int down, int left, int right)
+{
+  balance *b;
+  double t[2];
+  int size, r, c[2], k;
+
+  MPI_Comm_size(comm, &size);
+
+  b = (balance *) calloc(1, sizeof(balance));
+
+  b->freq = freq;
+  b->last = step0;
+  b->rowof = (int *) malloc(size*sizeof(int));
+  b->colof = (int *) malloc(size*sizeof(int));
+
+  for (r=0; r < size; r++)
+    {
+      MPI_Cart_coords(comm, r, 2, c);
+      b->rowof[r] = c[0];
+      b->colof[r] = c[1];
+    }
+
+  MPI_Barrier(comm);
+
+  t[0] = MPI_Wtime();
+
+  *g = migrate(*g, LXX, LYY, b->rowof, b->colof, comm);
+
+  t[0] = MPI_Wtime() - t[0];
+  t[1] = MPI_Wtime();
+
+  for (k=0; k < HALOTRIALS; k++)
+    {
+      gridhalo(*g, comm, up, down, left, right);
+    }
+
+  t[1] = (MPI_Wtime() - t[1])/HALOTRIALS;
+
+  MPI_Allreduce(MPI_IN_PLACE, t, 2, MPI_DOUBLE, MPI_MAX, comm);
+
+  // each exchange sends and receives 2(lx+ly) cells
+
+  b->tfixed = t[0];
+  b->tmove = t[1]/(2*((*g)->lx + (*g)->ly));
+  (*g)->tstep = 0;
+
+  return b;
+}
+
+/*
+ *  Every freq steps, rebalance if it is predicted to pay off. Returns
+ *  1 if the cells were moved, in which case *g is a new grid and LXX,
+ *  LYY, LX, LY, LLX and LLY are updated. comm must be the Cartesian
+ *  communicator of the process grid. Collective.
+ */
+
+int balancestep(balance *b, grid **g, long step, MPI_Comm comm)
+{
+  double t, before, after, *times, *rowt, *colt;
+  int rank, size, r, *newx, *newy, me[4], to[4], o[4];
+  const int *rowof = b->rowof, *colof = b->colof;
+  long n, moved;
+
+  if (step % b->freq != 0) return 0;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  t = (*g)->tstep/(step - b->last);
+  (*g)->tstep = 0;
+  b->last = step;
+
+  times = (double *) malloc(size*sizeof(double));
+  rowt = (double *) calloc(PROC_ROWS, sizeof(double));
+  colt = (double *) calloc(PROC_COLS, sizeof(double));
+  newx = (int *) malloc(PROC_ROWS*sizeof(int));
+  newy = (int *) malloc(PROC_COLS*sizeof(int));
+
+  MPI_Allgather(&t, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, comm);
+
+  /*
+   *  Rows first, limited by the slowest process in each, then columns
+   *  with the times scaled to the new rows
+   */
+
+  before = 0;
+
+  for (r=0; r < size; r++)
+    {
+      if (times[r] > rowt[rowof[r]]) rowt[rowof[r]] = times[r];
+      if (times[r] > before) before = times[r];
+    }
+
+  split(LXX, rowt, PROC_ROWS, newx);
+
+  for (r=0; r < size; r++)
+    {
+      t = times[r]*newx[rowof[r]]/LXX[rowof[r]];
+      if (t > colt[colof[r]]) colt[colof[r]] = t;
+    }
+
+  split(LYY, colt, PROC_COLS, newy);
+
+  /*
+   *  Predicted time of the slowest process afterwards, and the most
+   *  cells any process has to receive
+   */
+
+  after = 0;
+  moved = 0;
+
+  for (r=0; r < size; r++)
+    {
+      t = times[r]*newx[rowof[r]]/LXX[rowof[r]]*newy[colof[r]]/LYY[colof[r]];
+      if (t > after) after = t;
+
+      tile(LXX, LYY, rowof[r], colof[r], me);
+      tile(newx, newy, rowof[r], colof[r], to);
+
+      n = (long) to[2]*to[3] - intersect(me, to, o);
+      if (n > moved) moved = n;
+    }
+
+  if (moved == 0 || (before - after)*b->freq <= b->tfixed + moved*b->tmove)
+    {
+      free(times);
+      free(rowt);
+      free(colt);
+      free(newx);
+      free(newy);
+
+      return 0;
+    }
+
+  t = MPI_Wtime();
+
+  *g = migrate(*g, newx, newy, rowof, colof, comm);
+
+  t = MPI_Wtime() - t;
+
+  MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+  // the rebuild is assumed to take as long as before
+
+  if (t > b->tfixed) b->tmove = (t - b->tfixed)/moved;
+
+  b->before = before;
+  b->after = after;
+  b->moved = moved;
+  b->nmove++;
+  b->tspent += t;
+
+  memcpy(LXX, newx, PROC_ROWS*sizeof(int));
+  memcpy(LYY, newy, PROC_COLS*sizeof(int));
+
+  LX = LXX[rowof[rank]];
+  LY = LYY[colof[rank]];
+  LLX = LXX[0];
+  LLY = LYY[0];
+
+  free(times);
+  free(rowt);
+  free(colt);
+  free(newx);
+  free(newy);
+
+  return 1;
+}
+
+void balancefree(balance *b)
+{
+  free(b->rowof);
+  free(b->colof);
+  free(b);
+}
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "checkpoint.h"
+#include "largecount.h"
+
+checkpoint *ckptcreate(const char *name, grid *g)
+{
+  checkpoint *c;
+  int s;
+
+  c = (checkpoint *) calloc(1, sizeof(checkpoint));
+
+  c->name = name;
+
+  for (s=0; s < 2; s++)
+    {
+      c->buf[s] = (unsigned char *) malloc((size_t) g->lx*g->ly);
+      c->request[s] = MPI_REQUEST_NULL;
+      c->fh[s] = MPI_FILE_NULL;
+    }
+
+  c->agree = MPI_REQUEST_NULL;
+
+  return c;
+}
+
+/*
+ *  Complete the write in slot s, if any, then mark the file valid by
+ *  writing its header. The data of every process are synced before
+ *  the header is written, so a crash can never leave a valid header
+ *  over incomplete data. Collective.
+ */
+
+static void ckptfinish(checkpoint *c, int s, MPI_Comm comm)
+{
+  int rank;
+
+  // an agreement in flight is about this write; it is no longer needed
+
+  MPI_Wait(&c->agree, MPI_STATUS_IGNORE);
+
+  if (!c->active[s]) return;
+
+  MPI_Comm_rank(comm, &rank);
+
+  MPI_Wait(&c->request[s], MPI_STATUS_IGNORE);
+
+  MPI_File_sync(c->fh[s]);
+  MPI_Barrier(comm);
+
+  MPI_File_set_view(c->fh[s], 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+
+  if (rank == 0)
+    {
+      MPI_File_write_at(c->fh[s], 0, &c->header[s], sizeof(ckptheader),
+                        MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+  MPI_File_sync(c->fh[s]);
+  MPI_File_close(&c->fh[s]);
+
+  c->active[s] = 0;
+}
+
+/*
+ *  Called every step: finish the slot being written if the previous
+ *  step found its write complete on every process, otherwise check
+ *  again. Collective.
+ */
+
+void ckptpoll(checkpoint *c, MPI_Comm comm)
+{
+  int s = 1 - c->next;
+
+  if (c->agree != MPI_REQUEST_NULL)
+    {
+      MPI_Wait(&c->agree, MPI_STATUS_IGNORE);
+
+      if (c->alldone)
+        {
+          ckptfinish(c, s, comm);
+          return;
+        }
+    }
+
+  if (!c->active[s]) return;
+
+  MPI_Test(&c->request[s], &c->done, MPI_STATUS_IGNORE);
+
+  MPI_Iallreduce(&c->done, &c->alldone, 1, MPI_INT, MPI_MIN, comm, &c->agree);
+}
+
+/*
+ *  Start a checkpoint of the grid, with the header fields h (magic and
+ *  version are filled in here). Only the copy of the local tile into
+ *  the slot buffer is done before returning; the data go to disk while
+ *  the simulation continues. Collective.
+ */
+
+void ckptwrite(checkpoint *c, grid *g, ckptheader *h, MPI_Comm comm)
+{
+  char filename[1024];
+  ckptheader blank;
+  MPI_Datatype filetype, big;
+  int s, rank, count;
+
+  MPI_Comm_rank(comm, &rank);
+
+  s = c->next;
+  c->next = 1 - s;
+
+  // the previous checkpoint must be valid before this one is blanked
+
+  ckptfinish(c, 1 - s, comm);
+  ckptfinish(c, s, comm);
+
+  snprintf(filename, sizeof(filename), "%s.%d", c->name, s);
+
+  MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                MPI_INFO_NULL, &c->fh[s]);
+  MPI_File_set_size(c->fh[s], CKPTHEADER + (MPI_Offset) L*L);
+
+  // invalidate any older checkpoint in this file until the data are in
+
+  if (rank == 0)
+    {
+      memset(&blank, 0, sizeof(blank));
+      MPI_File_write_at(c->fh[s], 0, &blank, sizeof(blank), MPI_BYTE,
+                        MPI_STATUS_IGNORE);
+    }
+
+  gridgetbytes(g, c->buf[s]);
+
+  filetype = gridfiletype(g, MPI_UNSIGNED_CHAR);
+  MPI_File_set_view(c->fh[s], CKPTHEADER, MPI_UNSIGNED_CHAR, filetype,
+                    "native", MPI_INFO_NULL);
+  MPI_Type_free(&filetype);
+
+  count = largetype((long) g->lx*g->ly, MPI_UNSIGNED_CHAR, &big);
+  MPI_File_iwrite_all(c->fh[s], c->buf[s], count, big, &c->request[s]);
+  largefree(&big, MPI_UNSIGNED_CHAR);
+
+  c->header[s] = *h;
+  memcpy(c->header[s].magic, CKPTMAGIC, sizeof(c->header[s].magic));
+  c->header[s].version = CKPTVERSION;
+
+  c->active[s] = 1;
+}
+
+/*
+ *  Complete any outstanding checkpoints and size the buffers for the
+ *  new tile of g, keeping the slot order. Collective.
+ */
+
+void ckptresize(checkpoint *c, grid *g, MPI_Comm comm)
+{
+  int s;
+
+  ckptfinish(c, 1 - c->next, comm);
+  ckptfinish(c, c->next, comm);
+
+  for (s=0; s < 2; s++)
+    {
+      free(c->buf[s]);
+      c->buf[s] = (unsigned char *) malloc((size_t) g->lx*g->ly);
+    }
+}
+
+/*
+ *  Complete any outstanding checkpoints. Collective.
+ */
+
+void ckptfree(checkpoint *c, MPI_Comm comm)
+{
+  int s;
+
+  ckptfinish(c, 1 - c->next, comm);
+  ckptfinish(c, c->next, comm);
+
+  for (s=0; s < 2; s++)
+    {
+      free(c->buf[s]);
+    }
+
+  free(c);
+}
+
+/*
+ *  System size L of a complete checkpoint, read from its header on
+ *  rank 0, or 0 if the file is not one. Collective.
+ */
+
+int ckptsize(const char *filename, MPI_Comm comm)
+{
+  MPI_File fh;
+  ckptheader h;
+  int rank, l;
+
+  MPI_Comm_rank(comm, &rank);
+
+  l = 0;
+
+  if (rank == 0 &&
+      MPI_File_open(MPI_COMM_SELF, filename, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) == MPI_SUCCESS)
+    {
+      MPI_File_read_at(fh, 0, &h, sizeof(ckptheader), MPI_BYTE,
+                       MPI_STATUS_IGNORE);
+
+      if (memcmp(h.magic, CKPTMAGIC, sizeof(h.magic)) == 0 &&
+          h.version == CKPTVERSION && h.rule == RULE)
+        {
+          l = h.l;
+        }
+
+      MPI_File_close(&fh);
+    }
+
+  MPI_Bcast(&l, 1, MPI_INT, 0, comm);
+
+  return l;
+}
+
+/*
+ *  Read a checkpoint into the grid, whatever decomposition wrote it,
+ *  and return its header in h. Collective. Returns 0 on success and 1
+ *  if the file cannot be read or does not hold a complete checkpoint
+ *  of this system size.
+ */
+
+int ckptread(const char *filename, grid *g, ckptheader *h, MPI_Comm comm)
+{
+  MPI_File fh;
+  MPI_Datatype filetype, big;
+  unsigned char *buf;
+  int count;
+
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)
+      != MPI_SUCCESS)
+    {
+      return 1;
+    }
+
+  MPI_File_read_at_all(fh, 0, h, sizeof(ckptheader), MPI_BYTE,
+                       MPI_STATUS_IGNORE);
+
+  if (memcmp(h->magic, CKPTMAGIC, sizeof(h->magic)) != 0 ||
+      h->version != CKPTVERSION || h->l != L || h->rule != RULE)
+    {
+      MPI_File_close(&fh);
+      return 1;
+    }
+
+  buf = (unsigned char *) malloc((size_t) g->lx*g->ly);
+
+  filetype = gridfiletype(g, MPI_UNSIGNED_CHAR);
+  MPI_File_set_view(fh, CKPTHEADER, MPI_UNSIGNED_CHAR, filetype,
+                    "native", MPI_INFO_NULL);
+  MPI_Type_free(&filetype);
+
+  count = largetype((long) g->lx*g->ly, MPI_UNSIGNED_CHAR, &big);
+  MPI_File_read_all(fh, buf, count, big, MPI_STATUS_IGNORE);
+  largefree(&big, MPI_UNSIGNED_CHAR);
+
+  gridsetbytes(g, buf);
+
+  free(buf);
+  MPI_File_close(&fh);
+
+  return 0;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "cluster.h"
+
+#define CLUSTERTAG 2
+
+cluster *clustercreate(int freq, grid *g)
+{
+  cluster *c;
+  size_t n;
+  int k;
+
+  c = (cluster *) calloc(1, sizeof(cluster));
+
+  c->freq = freq;
+  c->lx = g->lx;
+  c->ly = g->ly;
+
+  n = (size_t) g->lx*g->ly;
+
+  c->cell = (unsigned char *) malloc(n);
+  c->parent = (long *) malloc(n*sizeof(long));
+  c->size = (long *) malloc(n*sizeof(long));
+  c->flags = (unsigned char *) malloc(n);
+
+  for (k=0; k < 2; k++)
+    {
+      c->send[k] = (long *) malloc((k == 0 ? g->ly : g->lx)*sizeof(long));
+      c->halo[k] = (long *) malloc((k == 0 ? g->ly : g->lx)*sizeof(long));
+    }
+
+  return c;
+}
+
+void clusterfree(cluster *c)
+{
+  int k;
+
+  for (k=0; k < 2; k++)
+    {
+      free(c->send[k]);
+      free(c->halo[k]);
+    }
+
+  free(c->cell);
+  free(c->parent);
+  free(c->size);
+  free(c->flags);
+  free(c);
+}
+
+/*
+ *  Union-find with path halving; the root of a tree is its smallest
+ *  element. Indices are long, as a tile can have more than INT_MAX
+ *  cells.
+ */
+
+static long findroot(long *parent, long k)
+{
+  while (parent[k] != k)
+    {
+      parent[k] = parent[parent[k]];
+      k = parent[k];
+    }
+
+  return k;
+}
+
+static void unite(long *parent, long a, long b)
+{
+  a = findroot(parent, a);
+  b = findroot(parent, b);
+
+  if (a < b) parent[b] = a;
+  if (b < a) parent[a] = b;
+}
+
+/*
+ *  The global label of a cluster is the global index of its root cell
+ */
+
+static long celllabel(cluster *c, grid *g, long k)
+{
+  long r;
+
+  if (!c->cell[k]) return -1;
+
+  r = findroot(c->parent, k);
+
+  return (g->x0 + r/c->ly)*(long) L + g->y0 + r%c->ly;
+}
+
+/*
+ *  Boundary clusters as sent to rank 0: label, size and flags
+ */
+
+#define ROOTLEN 3
+#define PAIRLEN 2
+
+static int cmplabel(const void *a, const void *b)
+{
+  long la = *(const long *) a;
+  long lb = *(const long *) b;
+
+  return (la > lb) - (la < lb);
+}
+
+static long findlabel(long *roots, int nroots, long label)
+{
+  long *r;
+
+  r = (long *) bsearch(&label, roots, nroots, ROOTLEN*sizeof(long), cmplabel);
+
+  return (r - roots) / ROOTLEN;
+}
+
+/*
+ *  Merge the clusters reaching the tile edges, given as nroots
+ *  (label, size, flags) triples, through npairs pairs of equivalent
+ *  labels. Adds the merged clusters to the statistics in c.
+ */
+
+static void mergeroots(cluster *c, long *roots, int nroots,
+                       long *pairs, int npairs)
+{
+  long *parent, *size, *flags;
+  long k, r;
+
+  qsort(roots, nroots, ROOTLEN*sizeof(long), cmplabel);
+
+  parent = (long *) malloc(nroots*sizeof(long));
+  size = (long *) calloc(nroots, sizeof(long));
+  flags = (long *) calloc(nroots, sizeof(long));
+
+  for (k=0; k < nroots; k++)
+    {
+      parent[k] = k;
+    }
+
+  for (k=0; k < npairs; k++)
+    {
+      unite(parent,
+            findlabel(roots, nroots, pairs[PAIRLEN*k]),
+            findlabel(roots, nroots, pairs[PAIRLEN*k+1]));
+    }
+
+  for (k=0; k < nroots; k++)
+    {
+      r = findroot(parent, k);
+      size[r] += roots[ROOTLEN*k+1];
+      flags[r] |= roots[ROOTLEN*k+2];
+    }
+
+  for (k=0; k < nroots; k++)
+    {
+      if (parent[k] != k) continue;
+
+      c->nclusters++;
+      if (size[k] > c->largest) c->largest = size[k];
+      if ((flags[k] & CLUSTER_LEFT) && (flags[k] & CLUSTER_RIGHT))
+        {
+          c->spanning = 1;
+        }
+    }
+
+  free(parent);
+  free(size);
+  free(flags);
+}
+
+/*
+ *  Gather n items of len longs from every process onto rank 0, which
+ *  gets the total number of items in *ntotal
+ */
+
+static long *gatherlongs(long *items, int n, int len, int *ntotal,
+                         MPI_Comm comm)
+{
+  int *counts, *displs;
+  long *all;
+  int k, rank, size;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  counts = (int *) malloc(size*sizeof(int));
+  displs = (int *) malloc(size*sizeof(int));
+
+  n *= len;
+  MPI_Gather(&n, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+  *ntotal = 0;
+  all = NULL;
+
+  if (rank == 0)
+    {
+      for (k=0; k < size; k++)
+        {
+          displs[k] = *ntotal;
+          *ntotal += counts[k];
+        }
+
+      all = (long *) malloc((*ntotal + 1)*sizeof(long));
+    }
+
+  MPI_Gatherv(items, n, MPI_LONG, all, counts, displs, MPI_LONG, 0, comm);
+
+  *ntotal /= len;
+
+  free(counts);
+  free(displs);
+
+  return all;
+}
+
+/*
+ *  Label the clusters if step is on the cadence. Returns 1 if it was,
+ *  with the results in c on every process, and 0 otherwise. Collective.
+ */
+
+int clusterstep(cluster *c, grid *g, long step, MPI_Comm comm,
+                int up, int down, int left, int right)
+{
+  long *roots, *pairs, *allroots, *allpairs;
+  long local[2], global[2], result[3], a, b, k, r;
+  int lx, ly, i, j, nroots, npairs, rank;
+
+  if (step % c->freq != 0) return 0;
+
+  MPI_Comm_rank(comm, &rank);
+
+  lx = c->lx;
+  ly = c->ly;
+
+  gridgetbytes(g, c->cell);
+
+  /*
+   *  Label the tile
+   */
+
+  for (i=0; i < lx; i++)
+    {
+      for (j=0; j < ly; j++)
+        {
+          k = (long) i*ly + j;
+
+          if (!c->cell[k])
+            {
+              c->parent[k] = -1;
+              continue;
+            }
+
+          c->parent[k] = k;
+          c->size[k] = 0;
+          c->flags[k] = 0;
+
+          if (i > 0 && c->cell[k-ly]) unite(c->parent, k, k-ly);
+          if (j > 0 && c->cell[k-1])  unite(c->parent, k, k-1);
+        }
+    }
+
+  for (i=0; i < lx; i++)
+    {
+      for (j=0; j < ly; j++)
+        {
+          k = (long) i*ly + j;
+
+          if (!c->cell[k]) continue;
+
+          r = findroot(c->parent, k);
+          c->size[r]++;
+
+          if (i == 0 || i == lx-1 || j == 0 || j == ly-1)
+            {
+              c->flags[r] |= CLUSTER_EDGE;
+            }
+          if (g->y0 + j == 0)   c->flags[r] |= CLUSTER_LEFT;
+          if (g->y0 + j == L-1) c->flags[r] |= CLUSTER_RIGHT;
+        }
+    }
+
+  /*
+   *  Clusters inside the tile are complete; keep the others to merge
+   */
+
+  roots = (long *) malloc(ROOTLEN*(2*(lx+ly) + 1)*sizeof(long));
+  nroots = 0;
+  local[0] = 0;
+  local[1] = 0;
+
+  for (k=0; k < (long) lx*ly; k++)
+    {
+      if (c->parent[k] != k) continue;
+
+      if (c->flags[k] & CLUSTER_EDGE)
+        {
+          roots[ROOTLEN*nroots]   = celllabel(c, g, k);
+          roots[ROOTLEN*nroots+1] = c->size[k];
+          roots[ROOTLEN*nroots+2] = c->flags[k];
+          nroots++;
+        }
+      else
+        {
+          local[0]++;
+          if (c->size[k] > local[1]) local[1] = c->size[k];
+        }
+    }
+
+  /*
+   *  Swap the labels of the first row and column with the neighbours,
+   *  so that each process sees those of the row below and the column
+   *  to the right of its tile. Nothing arrives from MPI_PROC_NULL.
+   */
+
+  for (j=0; j < ly; j++)
+    {
+      c->send[0][j] = celllabel(c, g, j);
+      c->halo[0][j] = -1;
+    }
+
+  for (i=0; i < lx; i++)
+    {
+      c->send[1][i] = celllabel(c, g, (long) i*ly);
+      c->halo[1][i] = -1;
+    }
+
+  MPI_Sendrecv(c->send[0], ly, MPI_LONG, up, CLUSTERTAG,
+               c->halo[0], ly, MPI_LONG, down, CLUSTERTAG,
+               comm, MPI_STATUS_IGNORE);
+
+  MPI_Sendrecv(c->send[1], lx, MPI_LONG, left, CLUSTERTAG,
+               c->halo[1], lx, MPI_LONG, right, CLUSTERTAG,
+               comm, MPI_STATUS_IGNORE);
+
+  /*
+   *  Pairs of labels joined across the bottom and right edges; runs
+   *  of the same pair along an edge are only sent once
+   */
+
+  pairs = (long *) malloc(PAIRLEN*(lx+ly)*sizeof(long));
+  npairs = 0;
+
+  for (k=0; k < ly + lx; k++)
+    {
+      if (k < ly)
+        {
+          a = celllabel(c, g, (long) (lx-1)*ly + k);
+          b = c->halo[0][k];
+        }
+      else
+        {
+          a = celllabel(c, g, (k-ly)*ly + ly-1);
+          b = c->halo[1][k-ly];
+        }
+
+      if (a < 0 || b < 0 || a == b) continue;
+
+      if (npairs > 0 && pairs[PAIRLEN*(npairs-1)] == a &&
+          pairs[PAIRLEN*(npairs-1)+1] == b) continue;
+
+      pairs[PAIRLEN*npairs]   = a;
+      pairs[PAIRLEN*npairs+1] = b;
+      npairs++;
+    }
+
+  /*
+   *  Merge on rank 0 and tell everyone
+   */
+
+  MPI_Reduce(&local[0], &global[0], 1, MPI_LONG, MPI_SUM, 0, comm);
+  MPI_Reduce(&local[1], &global[1], 1, MPI_LONG, MPI_MAX, 0, comm);
+
+  allroots = gatherlongs(roots, nroots, ROOTLEN, &nroots, comm);
+  allpairs = gatherlongs(pairs, npairs, PAIRLEN, &npairs, comm);
+
+  if (rank == 0)
+    {
+      c->nclusters = global[0];
+      c->largest = global[1];
+      c->spanning = 0;
+
+      mergeroots(c, allroots, nroots, allpairs, npairs);
+
+      result[0] = c->nclusters;
+      result[1] = c->largest;
+      result[2] = c->spanning;
+    }
+
+  MPI_Bcast(result, 3, MPI_LONG, 0, comm);
+
+  c->nclusters = result[0];
+  c->largest = result[1];
+  c->spanning = (int) result[2];
+
+  free(roots);
+  free(pairs);
+  free(allroots);
+  free(allpairs);
+
+  return 1;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "cycle.h"
+
+cycle *cyclecreate(int freq, int maxperiod)
+{
+  cycle *c;
+
+  c = (cycle *) calloc(1, sizeof(cycle));
+
+  c->freq = freq;
+  c->maxperiod = maxperiod;
+  c->nhist = maxperiod + CYCLECONFIRM + freq;
+
+  c->local  = (checksum *) malloc(freq*sizeof(checksum));
+  c->global = (checksum *) malloc(freq*sizeof(checksum));
+  c->hist   = (checksum *) malloc(c->nhist*sizeof(checksum));
+
+  return c;
+}
+
+void cyclefree(cycle *c)
+{
+  free(c->local);
+  free(c->global);
+  free(c->hist);
+  free(c);
+}
+
+/*
+ *  Global fingerprint number s (of step step0+s), which must still be
+ *  in the ring
+ */
+
+static checksum cyclehist(cycle *c, long s)
+{
+  return c->hist[s % c->nhist];
+}
+
+/*
+ *  Smallest period p <= maxperiod for which the last CYCLECONFIRM
+ *  fingerprints all repeat, or 0. Since the update is deterministic a
+ *  single repeated state already implies a cycle; the extra repeats
+ *  only guard against hash collisions.
+ */
+
+static int cyclefind(cycle *c)
+{
+  long s, last;
+  int p, k;
+
+  last = c->nstep - 1;
+
+  for (p=1; p <= c->maxperiod; p++)
+    {
+      if (last - p - CYCLECONFIRM + 1 < 0) break;
+
+      for (k=0; k < CYCLECONFIRM; k++)
+        {
+          s = last - k;
+          if (cyclehist(c, s) != cyclehist(c, s-p)) break;
+        }
+
+      if (k == CYCLECONFIRM)
+        {
+          /*
+           *  Walk back to the first step of the repeating stretch that
+           *  is still in the history
+           */
+
+          s = last - CYCLECONFIRM + 1;
+
+          while (s - p - 1 >= 0 && s - p - 1 > last - c->nhist &&
+                 cyclehist(c, s-1) == cyclehist(c, s-p-1))
+            {
+              s--;
+            }
+
+          c->start = c->step0 + s - p;
+          return p;
+        }
+    }
+
+  return 0;
+}
+
+/*
+ *  Record the local fingerprint of "step" (called on every step, by
+ *  every process). Every freq steps the buffered fingerprints are
+ *  reduced together and searched for a cycle. Returns the period
+ *  found (the same on all processes) or 0.
+ */
+
+int cyclepush(cycle *c, long step, checksum local, MPI_Comm comm)
+{
+  int k;
+
+  if (c->nstep == 0 && c->nbuf == 0) c->step0 = step;
+
+  c->local[c->nbuf++] = local;
+
+  if (c->nbuf < c->freq) return 0;
+
+  MPI_Allreduce(c->local, c->global, c->nbuf, MPI_CHECKSUM, MPI_SUM, comm);
+
+  for (k=0; k < c->nbuf; k++)
+    {
+      c->hist[c->nstep % c->nhist] = c->global[k];
+      c->nstep++;
+    }
+
+  c->period = cyclefind(c);
+
+  c->nbuf = 0;
+
+  return c->period;
+}
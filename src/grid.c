@@ -0,0 +1,2120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "arraymalloc.h"
+#include "grid.h"
+#include "kernel.h"
+
+static const char *mapdir = "."; // directory of the GRID_MAPPED files
+
+/*
+ *  Set the directory in which GRID_MAPPED grids create their files
+ */
+
+void gridmapdir(const char *dir)
+{
+  mapdir = dir;
+}
+
+/*
+ *  Create and map the file of a GRID_MAPPED grid. A new file reads as
+ *  zeros and only takes disk space as cells are written. Returns 0 on
+ *  success and 1 if the file cannot be created or mapped.
+ */
+
+static int mapcreate(grid *g)
+{
+  char name[1024];
+  int k;
+
+  g->mapsize = (size_t) g->lx*g->ly;
+
+  snprintf(name, sizeof(name), "%s/automaton.gridXXXXXX", mapdir);
+
+  g->mapfd = mkstemp(name);
+
+  if (g->mapfd < 0) return 1;
+
+  unlink(name);
+
+  if (ftruncate(g->mapfd, g->mapsize) != 0)
+    {
+      close(g->mapfd);
+      return 1;
+    }
+
+  g->map = (unsigned char *) mmap(NULL, g->mapsize, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, g->mapfd, 0);
+
+  if (g->map == MAP_FAILED)
+    {
+      close(g->mapfd);
+      return 1;
+    }
+
+  g->nband = MAPBAND/g->ly;
+  if (g->nband < 1) g->nband = 1;
+
+  for (k=0; k < 3; k++)
+    {
+      g->rowbuf[k] = (unsigned char *) calloc(g->ly+2, 1);
+    }
+
+  return 0;
+}
+
+/*
+ *  Allocate the local grid of lx x ly cells (plus halos) in the given
+ *  layout. All cells, including halos, start at zero. Returns NULL if
+ *  the file of a GRID_MAPPED grid cannot be created.
+ */
+
+grid *gridcreate(int lx, int ly, int layout)
+{
+  grid *g;
+  int s;
+
+  g = (grid *) calloc(1, sizeof(grid));
+
+  g->layout = layout;
+  g->lx = lx;
+  g->ly = ly;
+
+  if (layout == GRID_TILED)
+    {
+      g->nbx = (lx + GRIDBX - 1)/GRIDBX;
+      g->nby = (ly + GRIDBY - 1)/GRIDBY;
+
+      g->block = (int **) arraymalloc2daligned(g->nbx*g->nby, GRIDBX*GRIDBY,
+                                               sizeof(int), ALIGN, 0, HUGEPAGE);
+      g->next  = (int **) arraymalloc2daligned(g->nbx*g->nby, GRIDBX*GRIDBY,
+                                               sizeof(int), ALIGN, 0, HUGEPAGE);
+    }
+  else if (layout == GRID_MAPPED)
+    {
+      if (mapcreate(g) != 0)
+        {
+          free(g);
+          return NULL;
+        }
+    }
+  else
+    {
+      g->cell  = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int),
+                                               ALIGN, PITCH, HUGEPAGE);
+      g->neigh = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int),
+                                               ALIGN, PITCH, HUGEPAGE);
+      g->kernel = kernelwidth(ly);
+
+      MPI_Type_vector(lx, 1, g->cell[1] - g->cell[0], MPI_INT, &g->column);
+      MPI_Type_commit(&g->column);
+
+      /*
+       *  Contiguous column buffers for HALO_MANUAL (lx ints) and
+       *  HALO_PACK (packsize bytes)
+       */
+
+      g->halomode = HALO_VECTOR;
+      MPI_Pack_size(1, g->column, MPI_COMM_WORLD, &g->packsize);
+
+      if (g->packsize < lx*(int) sizeof(int)) g->packsize = lx*sizeof(int);
+
+      for (s=0; s < 2; s++)
+        {
+          g->colsend[s] = malloc(g->packsize);
+          g->colrecv[s] = malloc(g->packsize);
+        }
+    }
+
+  if (layout != GRID_ROWMAJOR)
+    {
+      for (s=0; s < 4; s++)
+        {
+          g->strip[s] = (int *) calloc(s < STRIP_LEFT ? ly : lx, sizeof(int));
+          g->halo[s]  = (int *) calloc(s < STRIP_LEFT ? ly : lx, sizeof(int));
+        }
+    }
+
+  return g;
+}
+
+static void aheadfree(gridahead *a);
+
+void gridfree(grid *g)
+{
+  int s;
+
+  if (g->layout != GRID_ROWMAJOR)
+    {
+      for (s=0; s < 4; s++)
+        {
+          free(g->strip[s]);
+          free(g->halo[s]);
+        }
+    }
+
+  if (g->layout == GRID_TILED)
+    {
+      free(g->block);
+      free(g->next);
+    }
+  else if (g->layout == GRID_MAPPED)
+    {
+      munmap(g->map, g->mapsize);
+      close(g->mapfd);
+
+      for (s=0; s < 3; s++)
+        {
+          free(g->rowbuf[s]);
+        }
+    }
+  else
+    {
+      free(g->cell);
+      free(g->neigh);
+      MPI_Type_free(&g->column);
+
+      for (s=0; s < 2; s++)
+        {
+          free(g->colsend[s]);
+          free(g->colrecv[s]);
+        }
+    }
+
+  if (g->nlive != NULL)
+    {
+      free(g->nlive);
+      free(g->nlivenext);
+      free(g->live);
+      free(g->livenext);
+
+      for (s=0; s < 4; s++)
+        {
+          free(g->stripsend[s]);
+          free(g->striprecv[s]);
+        }
+    }
+
+  if (g->ahead != NULL) aheadfree(g->ahead);
+
+  free(g->colkey);
+  free(g->flips);
+  free(g);
+}
+
+/*
+ *  Position of interior cell (i, j) in the tiled layout
+ */
+
+static int *tiledcell(grid *g, int i, int j)
+{
+  int bi = (i-1)/GRIDBX;
+  int bj = (j-1)/GRIDBY;
+
+  return g->block[bi*g->nby+bj] + ((i-1)%GRIDBX)*GRIDBY + (j-1)%GRIDBY;
+}
+
+/*
+ *  Row i of the mapped layout: cell (i, j) is at [j-1]
+ */
+
+static unsigned char *mappedrow(grid *g, int i)
+{
+  return g->map + (size_t) (i-1)*g->ly;
+}
+
+/*
+ *  Single-cell accessors, including halos. Corner halo cells read as
+ *  zero and writes to them are ignored in the tiled and mapped
+ *  layouts.
+ */
+
+int gridget(grid *g, int i, int j)
+{
+  if (g->layout == GRID_ROWMAJOR) return g->cell[i][j];
+
+  if (i == 0 || i == g->lx+1)
+    {
+      if (j < 1 || j > g->ly) return 0;
+      return g->halo[i == 0 ? STRIP_UP : STRIP_DOWN][j-1];
+    }
+
+  if (j == 0)       return g->halo[STRIP_LEFT][i-1];
+  if (j == g->ly+1) return g->halo[STRIP_RIGHT][i-1];
+
+  if (g->layout == GRID_MAPPED) return mappedrow(g, i)[j-1];
+
+  return *tiledcell(g, i, j);
+}
+
+void gridset(grid *g, int i, int j, int val)
+{
+  if (g->layout == GRID_ROWMAJOR)
+    {
+      g->cell[i][j] = val;
+      return;
+    }
+
+  if (i == 0 || i == g->lx+1)
+    {
+      if (j >= 1 && j <= g->ly)
+        {
+          g->halo[i == 0 ? STRIP_UP : STRIP_DOWN][j-1] = val;
+        }
+      return;
+    }
+
+  if (j == 0)
+    {
+      g->halo[STRIP_LEFT][i-1] = val;
+      return;
+    }
+
+  if (j == g->ly+1)
+    {
+      g->halo[STRIP_RIGHT][i-1] = val;
+      return;
+    }
+
+  if (g->layout == GRID_MAPPED)
+    mappedrow(g, i)[j-1] = (unsigned char) val;
+  else
+    *tiledcell(g, i, j) = val;
+
+  if (g->nlive != NULL) g->nlive[((i-1)/GRIDBX)*g->nby + (j-1)/GRIDBY] = -1;
+
+  // keep the boundary strips in step with the blocks
+
+  if (i == 1)     g->strip[STRIP_UP][j-1]    = val;
+  if (i == g->lx) g->strip[STRIP_DOWN][j-1]  = val;
+  if (j == 1)     g->strip[STRIP_LEFT][i-1]  = val;
+  if (j == g->ly) g->strip[STRIP_RIGHT][i-1] = val;
+}
+
+/*
+ *  Row accessors: copy cells (i, 1) ... (i, ly) to or from row[0] ...
+ *  row[ly-1]. Row i may be a halo row.
+ */
+
+void gridgetrow(grid *g, int i, int *row)
+{
+  unsigned char *m;
+  int bj, ny, j;
+
+  if (g->layout == GRID_ROWMAJOR)
+    {
+      memcpy(row, &g->cell[i][1], g->ly*sizeof(int));
+      return;
+    }
+
+  if (i == 0 || i == g->lx+1)
+    {
+      memcpy(row, g->halo[i == 0 ? STRIP_UP : STRIP_DOWN], g->ly*sizeof(int));
+      return;
+    }
+
+  if (g->layout == GRID_MAPPED)
+    {
+      m = mappedrow(g, i);
+
+      for (j=0; j < g->ly; j++)
+        {
+          row[j] = m[j];
+        }
+      return;
+    }
+
+  for (bj=0; bj < g->nby; bj++)
+    {
+      ny = g->ly - bj*GRIDBY < GRIDBY ? g->ly - bj*GRIDBY : GRIDBY;
+      memcpy(row + bj*GRIDBY, tiledcell(g, i, bj*GRIDBY+1), ny*sizeof(int));
+    }
+}
+
+void gridsetrow(grid *g, int i, const int *row)
+{
+  unsigned char *m;
+  int bj, ny, j;
+
+  if (g->layout == GRID_ROWMAJOR)
+    {
+      memcpy(&g->cell[i][1], row, g->ly*sizeof(int));
+      return;
+    }
+
+  if (i == 0 || i == g->lx+1)
+    {
+      memcpy(g->halo[i == 0 ? STRIP_UP : STRIP_DOWN], row, g->ly*sizeof(int));
+      return;
+    }
+
+  if (g->layout == GRID_MAPPED)
+    {
+      m = mappedrow(g, i);
+
+      for (j=0; j < g->ly; j++)
+        {
+          m[j] = (unsigned char) row[j];
+        }
+    }
+  else
+    {
+      for (bj=0; bj < g->nby; bj++)
+        {
+          ny = g->ly - bj*GRIDBY < GRIDBY ? g->ly - bj*GRIDBY : GRIDBY;
+          memcpy(tiledcell(g, i, bj*GRIDBY+1), row + bj*GRIDBY, ny*sizeof(int));
+
+          if (g->nlive != NULL) g->nlive[((i-1)/GRIDBX)*g->nby + bj] = -1;
+        }
+    }
+
+  if (i == 1)     memcpy(g->strip[STRIP_UP],   row, g->ly*sizeof(int));
+  if (i == g->lx) memcpy(g->strip[STRIP_DOWN], row, g->ly*sizeof(int));
+
+  g->strip[STRIP_LEFT][i-1]  = row[0];
+  g->strip[STRIP_RIGHT][i-1] = row[g->ly-1];
+}
+
+/*
+ *  Swap halos with the four neighbours. In the tiled and mapped
+ *  layouts every message is a contiguous strip and nothing needs to
+ *  be packed. In
+ *  the row-major layout the columns are sent according to halomode.
+ */
+
+/*
+ *  Count the bytes of cells sent to each neighbour
+ */
+
+static void countbytes(grid *g, int up, int down, int left, int right)
+{
+  if (up != MPI_PROC_NULL)    g->halobytes[STRIP_UP]    += g->ly*sizeof(int);
+  if (down != MPI_PROC_NULL)  g->halobytes[STRIP_DOWN]  += g->ly*sizeof(int);
+  if (left != MPI_PROC_NULL)  g->halobytes[STRIP_LEFT]  += g->lx*sizeof(int);
+  if (right != MPI_PROC_NULL) g->halobytes[STRIP_RIGHT] += g->lx*sizeof(int);
+}
+
+/*
+ *  Strip of n cells as sent in GRID_SPARSE: the number of living
+ *  cells and their positions if that is shorter, else -1 and the
+ *  cells. Returns the number of ints in buf.
+ */
+
+static int packstrip(const int *strip, int n, int *buf)
+{
+  int k, m;
+
+  for (k=0, m=0; k < n; k++)
+    {
+      m += strip[k];
+    }
+
+  if (m >= n)
+    {
+      buf[0] = -1;
+      memcpy(buf+1, strip, n*sizeof(int));
+      return n+1;
+    }
+
+  buf[0] = m;
+
+  for (k=0, m=1; k < n; k++)
+    {
+      if (strip[k]) buf[m++] = k;
+    }
+
+  return m;
+}
+
+static void unpackstrip(const int *buf, int n, int *strip)
+{
+  int k;
+
+  if (buf[0] < 0)
+    {
+      memcpy(strip, buf+1, n*sizeof(int));
+      return;
+    }
+
+  memset(strip, 0, n*sizeof(int));
+
+  for (k=1; k <= buf[0]; k++)
+    {
+      strip[buf[k]] = 1;
+    }
+}
+
+/*
+ *  Halo swap of GRID_SPARSE with packed strips; the bytes counted are
+ *  those sent. Tags as in gridstepasync.
+ */
+
+static void sparsehalo(grid *g, MPI_Comm comm, int up, int down, int left,
+                       int right)
+{
+  MPI_Request requests[8];
+  int neighbour[4];
+  int s, n, len;
+
+  neighbour[STRIP_UP] = up;
+  neighbour[STRIP_DOWN] = down;
+  neighbour[STRIP_LEFT] = left;
+  neighbour[STRIP_RIGHT] = right;
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+      MPI_Irecv(g->striprecv[s], n+1, MPI_INT, neighbour[s], ASYNCTAG+s, comm,
+                &requests[s]);
+    }
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+      len = packstrip(g->strip[s], n, g->stripsend[s]);
+
+      MPI_Issend(g->stripsend[s], len, MPI_INT, neighbour[s], ASYNCTAG+(s^1),
+                 comm, &requests[4+s]);
+
+      if (neighbour[s] != MPI_PROC_NULL) g->halobytes[s] += len*sizeof(int);
+    }
+
+  MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+
+  for (s=0; s < 4; s++)
+    {
+      if (neighbour[s] == MPI_PROC_NULL) continue;
+
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+      unpackstrip(g->striprecv[s], n, g->halo[s]);
+    }
+}
+
+void gridhalo(grid *g, MPI_Comm comm, int up, int down, int left, int right)
+{
+  MPI_Request requests[8]; // Requests for Non-blocking communication
+  int tag = 1;
+  int lx = g->lx;
+  int ly = g->ly;
+  int pos;
+
+  if (g->nlive != NULL)
+    {
+      sparsehalo(g, comm, up, down, left, right);
+      return;
+    }
+
+  countbytes(g, up, down, left, right);
+
+  if (g->layout != GRID_ROWMAJOR)
+    {
+      MPI_Issend(g->strip[STRIP_UP], ly, MPI_INT, up, tag, comm, &requests[0]);
+      MPI_Irecv(g->halo[STRIP_DOWN], ly, MPI_INT, down, tag, comm, &requests[1]);
+      MPI_Issend(g->strip[STRIP_DOWN], ly, MPI_INT, down, tag, comm, &requests[2]);
+      MPI_Irecv(g->halo[STRIP_UP], ly, MPI_INT, up, tag, comm, &requests[3]);
+
+      MPI_Issend(g->strip[STRIP_LEFT], lx, MPI_INT, left, tag, comm, &requests[4]);
+      MPI_Irecv(g->halo[STRIP_RIGHT], lx, MPI_INT, right, tag, comm, &requests[5]);
+      MPI_Issend(g->strip[STRIP_RIGHT], lx, MPI_INT, right, tag, comm, &requests[6]);
+      MPI_Irecv(g->halo[STRIP_LEFT], lx, MPI_INT, left, tag, comm, &requests[7]);
+
+      MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+      return;
+    }
+
+  int **cell = g->cell;
+
+  MPI_Issend(&cell[1][1], ly, MPI_INT, up, tag, comm, &requests[0]);
+  MPI_Irecv(&cell[lx+1][1], ly, MPI_INT, down, tag, comm, &requests[1]);
+  MPI_Issend(&cell[lx][1], ly, MPI_INT, down, tag, comm, &requests[2]);
+  MPI_Irecv(&cell[0][1], ly, MPI_INT, up, tag, comm, &requests[3]);
+
+  switch (g->halomode)
+    {
+    case HALO_MANUAL:
+
+      kernelpackcolumns(cell, lx, ly, g->colsend[0], g->colsend[1]);
+
+      MPI_Issend(g->colsend[0], lx, MPI_INT, left, tag, comm, &requests[4]);
+      MPI_Irecv(g->colrecv[1], lx, MPI_INT, right, tag, comm, &requests[5]);
+      MPI_Issend(g->colsend[1], lx, MPI_INT, right, tag, comm, &requests[6]);
+      MPI_Irecv(g->colrecv[0], lx, MPI_INT, left, tag, comm, &requests[7]);
+      break;
+
+    case HALO_PACK:
+
+      pos = 0;
+      MPI_Pack(&cell[1][1], 1, g->column, g->colsend[0], g->packsize, &pos, comm);
+      pos = 0;
+      MPI_Pack(&cell[1][ly], 1, g->column, g->colsend[1], g->packsize, &pos, comm);
+
+      MPI_Issend(g->colsend[0], pos, MPI_PACKED, left, tag, comm, &requests[4]);
+      MPI_Irecv(g->colrecv[1], pos, MPI_PACKED, right, tag, comm, &requests[5]);
+      MPI_Issend(g->colsend[1], pos, MPI_PACKED, right, tag, comm, &requests[6]);
+      MPI_Irecv(g->colrecv[0], pos, MPI_PACKED, left, tag, comm, &requests[7]);
+      break;
+
+    default:
+
+      MPI_Issend(&cell[1][1], 1, g->column, left, tag, comm, &requests[4]);
+      MPI_Irecv(&cell[1][ly+1], 1, g->column, right, tag, comm, &requests[5]);
+      MPI_Issend(&cell[1][ly], 1, g->column, right, tag, comm, &requests[6]);
+      MPI_Irecv(&cell[1][0], 1, g->column, left, tag, comm, &requests[7]);
+      break;
+    }
+
+  MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+
+  /*
+   *  Nothing is received from MPI_PROC_NULL, so the fixed boundary
+   *  columns at the edges of the grid must not be overwritten
+   */
+
+  if (g->halomode == HALO_MANUAL)
+    {
+      if (left  != MPI_PROC_NULL) kernelunpackcolumn(cell, lx, 0, g->colrecv[0]);
+      if (right != MPI_PROC_NULL) kernelunpackcolumn(cell, lx, ly+1, g->colrecv[1]);
+    }
+  else if (g->halomode == HALO_PACK)
+    {
+      if (left != MPI_PROC_NULL)
+        {
+          pos = 0;
+          MPI_Unpack(g->colrecv[0], g->packsize, &pos, &cell[1][0], 1, g->column, comm);
+        }
+      if (right != MPI_PROC_NULL)
+        {
+          pos = 0;
+          MPI_Unpack(g->colrecv[1], g->packsize, &pos, &cell[1][ly+1], 1, g->column, comm);
+        }
+    }
+}
+
+/*
+ *  Time HALOTRIALS halo swaps with each column strategy, taking the
+ *  slowest process for each, and keep the fastest strategy in the
+ *  grid. The halos are refreshed with the values they would receive
+ *  anyway, so this can run on the initialised grid. The times per
+ *  swap (seconds) are returned in times[], which has room for three.
+ *  Returns the strategy chosen, or HALO_AUTO for the tiled and mapped
+ *  layouts which never pack.
+ */
+
+int gridhalotune(grid *g, MPI_Comm comm, int up, int down, int left, int right,
+                 double *times)
+{
+  int mode, best, k;
+  double t;
+
+  if (g->layout != GRID_ROWMAJOR) return HALO_AUTO;
+
+  best = HALO_VECTOR;
+
+  for (mode=HALO_VECTOR; mode <= HALO_PACK; mode++)
+    {
+      g->halomode = mode;
+
+      gridhalo(g, comm, up, down, left, right); // warm up
+
+      MPI_Barrier(comm);
+      t = MPI_Wtime();
+
+      for (k=0; k < HALOTRIALS; k++)
+        {
+          gridhalo(g, comm, up, down, left, right);
+        }
+
+      t = (MPI_Wtime() - t)/HALOTRIALS;
+
+      MPI_Allreduce(&t, &times[mode], 1, MPI_DOUBLE, MPI_MAX, comm);
+
+      if (times[mode] < times[best]) best = mode;
+    }
+
+  g->halomode = best;
+
+  return best;
+}
+
+/*
+ *  Size nx x ny of block (bi, bj), which is smaller at the far edges
+ */
+
+static void blocksize(grid *g, int bi, int bj, int *nx, int *ny)
+{
+  *nx = g->lx - bi*GRIDBX < GRIDBX ? g->lx - bi*GRIDBX : GRIDBX;
+  *ny = g->ly - bj*GRIDBY < GRIDBY ? g->ly - bj*GRIDBY : GRIDBY;
+}
+
+/*
+ *  Refresh the boundary strips that will be sent next step from the
+ *  new cells out of block (bi, bj)
+ */
+
+static void blockstrips(grid *g, int *const *strip, int bi, int bj,
+                        const int *out)
+{
+  int ii, nx, ny;
+  int i0 = bi*GRIDBX;
+  int j0 = bj*GRIDBY;
+
+  blocksize(g, bi, bj, &nx, &ny);
+
+  if (bi == 0)
+    memcpy(strip[STRIP_UP] + j0, out, ny*sizeof(int));
+
+  if (bi == g->nbx-1)
+    memcpy(strip[STRIP_DOWN] + j0, out + (nx-1)*GRIDBY, ny*sizeof(int));
+
+  for (ii=0; ii < nx; ii++)
+    {
+      if (bj == 0)        strip[STRIP_LEFT][i0+ii]  = out[ii*GRIDBY];
+      if (bj == g->nby-1) strip[STRIP_RIGHT][i0+ii] = out[ii*GRIDBY+ny-1];
+    }
+}
+
+/*
+ *  Update one block of the tiled layout from the blocks cur and halos
+ *  into the blocks next and the strips. The block and a one-cell ring
+ *  around it are copied to a small scratch array that stays in L1
+ *  cache; the ring comes from neighbouring blocks or, at the edge of
+ *  the tile, from the halo strips.
+ */
+
+static int stepblock(grid *g, int *const *cur, int *const *next,
+                     int *const *halo, int *const *strip, int bi, int bj,
+                     checksum *hash, long *nflip)
+{
+  int s[GRIDBX+2][GRIDBY+2];
+  int ii, jj, n, nx, ny, i0, j0, ncell;
+  int nby = g->nby;
+  const int *b = cur[bi*nby+bj];
+  int *out = next[bi*nby+bj];
+
+  i0 = bi*GRIDBX;
+  j0 = bj*GRIDBY;
+  nx = g->lx - i0 < GRIDBX ? g->lx - i0 : GRIDBX;
+  ny = g->ly - j0 < GRIDBY ? g->ly - j0 : GRIDBY;
+
+  for (ii=0; ii < nx; ii++)
+    {
+      memcpy(&s[ii+1][1], b + ii*GRIDBY, ny*sizeof(int));
+    }
+
+  if (bi == 0)
+    memcpy(&s[0][1], halo[STRIP_UP] + j0, ny*sizeof(int));
+  else
+    memcpy(&s[0][1], cur[(bi-1)*nby+bj] + (GRIDBX-1)*GRIDBY, ny*sizeof(int));
+
+  if (bi == g->nbx-1)
+    memcpy(&s[nx+1][1], halo[STRIP_DOWN] + j0, ny*sizeof(int));
+  else
+    memcpy(&s[nx+1][1], cur[(bi+1)*nby+bj], ny*sizeof(int));
+
+  for (ii=0; ii < nx; ii++)
+    {
+      s[ii+1][0] = (bj == 0) ? halo[STRIP_LEFT][i0+ii]
+                             : cur[bi*nby+bj-1][ii*GRIDBY+GRIDBY-1];
+
+      s[ii+1][ny+1] = (bj == nby-1) ? halo[STRIP_RIGHT][i0+ii]
+                                    : cur[bi*nby+bj+1][ii*GRIDBY];
+    }
+
+  ncell = 0;
+  *nflip = 0;
+
+  if (g->flips != NULL)
+    {
+      for (ii=1; ii <= nx; ii++)
+        {
+          unsigned int *fl = g->flips + (size_t) (i0+ii-1)*g->ly + j0;
+          int v, d[GRIDBY], rowflip = 0;
+
+          // flips go through d so that the stores to fl and out
+          // cannot alias within the vectorised loop
+
+          for (jj=1; jj <= ny; jj++)
+            {
+              n = s[ii][jj] + s[ii][jj+1] + s[ii][jj-1] + s[ii+1][jj] + s[ii-1][jj];
+
+              v = (n == 5 || n == 4 || n == 2);
+              d[jj-1] = s[ii][jj] ^ v;
+              out[(ii-1)*GRIDBY+jj-1] = v;
+              rowflip += d[jj-1];
+              ncell += v;
+            }
+
+          for (jj=0; jj < ny; jj++)
+            {
+              fl[jj] += d[jj];
+            }
+
+          *nflip += rowflip;
+        }
+    }
+  else
+    {
+      for (ii=1; ii <= nx; ii++)
+        {
+          for (jj=1; jj <= ny; jj++)
+            {
+              n = s[ii][jj] + s[ii][jj+1] + s[ii][jj-1] + s[ii+1][jj] + s[ii-1][jj];
+
+              out[(ii-1)*GRIDBY+jj-1] = (n == 5 || n == 4 || n == 2);
+              ncell += out[(ii-1)*GRIDBY+jj-1];
+            }
+        }
+    }
+
+  *hash = 0;
+
+  if (g->track)
+    {
+      const checksum *ck = g->colkey + j0 - 1;
+
+      for (ii=1; ii <= nx; ii++)
+        {
+          checksum rowsum = 0;
+
+          for (jj=1; jj <= ny; jj++)
+            {
+              rowsum += flipkey(s[ii][jj], out[(ii-1)*GRIDBY+jj-1], ck[jj]);
+            }
+
+          *hash += rowhash(g->x0+i0+ii-1)*rowsum;
+        }
+    }
+
+  blockstrips(g, strip, bi, bj, out);
+
+  return ncell;
+}
+
+/*
+ *  Update one listed block into g->next. The candidates are its
+ *  living cells, their neighbours in the block and the cells next to
+ *  a living cell of the ring, which is read edge by edge; everything
+ *  else is dead with no living neighbour and stays dead. The cells
+ *  listed for next are cleared first, so the cost is the perimeter
+ *  plus the number of living cells, not the area.
+ */
+
+static int sparseblock(grid *g, int bi, int bj, checksum *hash, long *nflip)
+{
+  int up[GRIDBY], down[GRIDBY], left[GRIDBX], right[GRIDBX];
+  unsigned long long seen[GRIDBX*GRIDBY/64];
+  unsigned short cand[GRIDBX*GRIDBY];
+  int ii, jj, k, p, n, v, c, nx, ny, nc, ncell;
+  int nby = g->nby;
+  int b = bi*nby+bj;
+  int i0 = bi*GRIDBX;
+  int j0 = bj*GRIDBY;
+  const int *cur = g->block[b];
+  int *out = g->next[b];
+  const unsigned short *live = g->live[b];
+  unsigned short *list = g->livenext[b];
+
+  blocksize(g, bi, bj, &nx, &ny);
+
+  // the ring
+
+  if (bi == 0)
+    memcpy(up, g->halo[STRIP_UP] + j0, ny*sizeof(int));
+  else
+    memcpy(up, g->block[b-nby] + (GRIDBX-1)*GRIDBY, ny*sizeof(int));
+
+  if (bi == g->nbx-1)
+    memcpy(down, g->halo[STRIP_DOWN] + j0, ny*sizeof(int));
+  else
+    memcpy(down, g->block[b+nby], ny*sizeof(int));
+
+  for (ii=0; ii < nx; ii++)
+    {
+      left[ii] = (bj == 0) ? g->halo[STRIP_LEFT][i0+ii]
+                           : g->block[b-1][ii*GRIDBY+GRIDBY-1];
+
+      right[ii] = (bj == nby-1) ? g->halo[STRIP_RIGHT][i0+ii]
+                                : g->block[b+1][ii*GRIDBY];
+    }
+
+  *hash = 0;
+  *nflip = 0;
+
+  // a dead block in a dead ring stays dead
+
+  if (g->nlive[b] == 0 && g->nlivenext[b] == 0)
+    {
+      v = 0;
+
+      for (jj=0; jj < ny; jj++) v |= up[jj] | down[jj];
+      for (ii=0; ii < nx; ii++) v |= left[ii] | right[ii];
+
+      if (!v)
+        {
+          blockstrips(g, g->strip, bi, bj, out);
+          return 0;
+        }
+    }
+
+  // next is left all dead
+
+  if (g->nlivenext[b] >= 0)
+    {
+      for (k=0; k < g->nlivenext[b]; k++)
+        {
+          out[list[k]] = 0;
+        }
+    }
+  else
+    {
+      for (ii=0; ii < nx; ii++)
+        {
+          memset(out + ii*GRIDBY, 0, ny*sizeof(int));
+        }
+    }
+
+  /*
+   *  Collect each candidate once
+   */
+
+  memset(seen, 0, sizeof(seen));
+  nc = 0;
+
+#define CANDIDATE(q) \
+  if (!((seen[(q) >> 6] >> ((q) & 63)) & 1)) \
+    { seen[(q) >> 6] |= 1ULL << ((q) & 63); cand[nc++] = (q); }
+
+  for (k=0; k < g->nlive[b]; k++)
+    {
+      p = live[k];
+      ii = p/GRIDBY;
+      jj = p%GRIDBY;
+
+      CANDIDATE(p);
+      if (ii > 0)    CANDIDATE(p-GRIDBY);
+      if (ii < nx-1) CANDIDATE(p+GRIDBY);
+      if (jj > 0)    CANDIDATE(p-1);
+      if (jj < ny-1) CANDIDATE(p+1);
+    }
+
+  for (jj=0; jj < ny; jj++)
+    {
+      if (up[jj])   CANDIDATE(jj);
+      if (down[jj]) CANDIDATE((nx-1)*GRIDBY+jj);
+    }
+
+  for (ii=0; ii < nx; ii++)
+    {
+      if (left[ii])  CANDIDATE(ii*GRIDBY);
+      if (right[ii]) CANDIDATE(ii*GRIDBY+ny-1);
+    }
+
+#undef CANDIDATE
+
+  /*
+   *  Update the candidates, listing the living ones for next step
+   */
+
+  ncell = 0;
+
+  for (k=0; k < nc; k++)
+    {
+      p = cand[k];
+      ii = p/GRIDBY;
+      jj = p%GRIDBY;
+      c = cur[p];
+
+      n =   c
+          + (ii > 0    ? cur[p-GRIDBY] : up[jj])
+          + (ii < nx-1 ? cur[p+GRIDBY] : down[jj])
+          + (jj > 0    ? cur[p-1]      : left[ii])
+          + (jj < ny-1 ? cur[p+1]      : right[ii]);
+
+      v = (n == 5 || n == 4 || n == 2);
+
+      if (v)
+        {
+          out[p] = 1;
+          if (ncell < SPARSEMAX) list[ncell] = p;
+          ncell++;
+        }
+
+      if (v != c)
+        {
+          if (g->track)
+            {
+              *hash += rowhash(g->x0+i0+ii)*flipkey(c, v, g->colkey[j0+jj]);
+            }
+
+          if (g->flips != NULL)
+            {
+              g->flips[(size_t) (i0+ii)*g->ly + j0+jj]++;
+              (*nflip)++;
+            }
+        }
+    }
+
+  g->nlivenext[b] = (ncell <= SPARSEMAX) ? ncell : -1;
+
+  blockstrips(g, g->strip, bi, bj, out);
+
+  return ncell;
+}
+
+/*
+ *  Update block (bi, bj) in full or from its list. In GRID_SPARSE a
+ *  block updated in full that ends up with few living cells is listed
+ *  for the next step. Sets *sparse if the list was used.
+ */
+
+static int updateblock(grid *g, int bi, int bj, checksum *hash, long *nflip,
+                       int *sparse)
+{
+  int b = bi*g->nby+bj;
+  int ii, jj, nx, ny, n, ncell;
+  const int *out;
+
+  *sparse = (g->nlive != NULL && g->nlive[b] >= 0);
+
+  if (*sparse) return sparseblock(g, bi, bj, hash, nflip);
+
+  ncell = stepblock(g, g->block, g->next, g->halo, g->strip, bi, bj, hash,
+                    nflip);
+
+  if (g->nlive == NULL) return ncell;
+
+  g->nlivenext[b] = -1;
+
+  if (ncell <= SPARSELIVE)
+    {
+      blocksize(g, bi, bj, &nx, &ny);
+      out = g->next[b];
+      n = 0;
+
+      for (ii=0; ii < nx; ii++)
+        {
+          for (jj=0; jj < ny; jj++)
+            {
+              if (out[ii*GRIDBY+jj]) g->livenext[b][n++] = ii*GRIDBY+jj;
+            }
+        }
+
+      g->nlivenext[b] = n;
+    }
+
+  return ncell;
+}
+
+/*
+ *  Make next the current blocks, with their lists
+ */
+
+static void swapblocks(grid *g)
+{
+  int **tmp;
+  int *ntmp;
+  unsigned short **ltmp;
+
+  tmp = g->block;
+  g->block = g->next;
+  g->next = tmp;
+
+  if (g->nlive == NULL) return;
+
+  ntmp = g->nlive;
+  g->nlive = g->nlivenext;
+  g->nlivenext = ntmp;
+
+  ltmp = g->live;
+  g->live = g->livenext;
+  g->livenext = ltmp;
+}
+
+/*
+ *  Set the halos to the fixed boundary of the automaton: zero, except
+ *  that the j = 0 and j = L-1 edges of the global grid are alive from
+ *  row L/6 to row 5L/6 (counting rows from 1). The i halos are always
+ *  overwritten by the periodic exchange.
+ */
+
+void gridboundary(grid *g)
+{
+  int i, j, val;
+
+  for (j=1; j <= g->ly; j++)
+    {
+      gridset(g, 0, j, 0);
+      gridset(g, g->lx+1, j, 0);
+    }
+
+  for (i=1; i <= g->lx; i++)
+    {
+      val = (g->x0+i >= L/6 && g->x0+i <= (5*L)/6);
+
+      gridset(g, i, 0, (g->y0 == 0) ? val : 0);
+      gridset(g, i, g->ly+1, (g->y0+g->ly == L) ? val : 0);
+    }
+}
+
+/*
+ *  Bytes of the map holding rows i0 ... i1, clipped to the tile, as
+ *  whole pages: either all the pages they touch, or only those which
+ *  hold no other row. Returns 0 if there are none.
+ */
+
+static int maprange(grid *g, int i0, int i1, int inward, size_t *start,
+                    size_t *len)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t first, last;
+
+  if (i0 < 1) i0 = 1;
+  if (i1 > g->lx) i1 = g->lx;
+  if (i0 > i1) return 0;
+
+  first = (size_t) (i0-1)*g->ly;
+  last = (size_t) i1*g->ly;
+
+  if (inward)
+    {
+      first = ((first + page - 1)/page)*page;
+      last = (last/page)*page;
+    }
+  else
+    {
+      first = (first/page)*page;
+      last = ((last + page - 1)/page)*page;
+    }
+
+  if (last <= first) return 0;
+
+  *start = first;
+  *len = last - first;
+
+  return 1;
+}
+
+/*
+ *  Update the mapped layout band by band, in place: each row is
+ *  copied before it is overwritten, so the update of row i reads the
+ *  old rows i-1 and i from rowbuf and row i+1 from the map, which is
+ *  only written once.
+ *
+ *  While band b is updated, band b+1 is read ahead. Once it is done,
+ *  its write-back is started (POSIX_FADV_DONTNEED writes dirty pages
+ *  back without waiting and keeps them) and band b-1, written back
+ *  meanwhile, is unmapped and dropped, so a tile larger than memory
+ *  is streamed through about three bands at the speed of the storage.
+ *  A tile of three bands or less is left to the page cache.
+ */
+
+static long stepmapped(grid *g)
+{
+  const int lx = g->lx;
+  const int ly = g->ly;
+  const int nband = g->nband;
+  const int stream = (lx > 3*nband); // else the tile stays in memory
+  const int track = g->track;
+  const int count = (g->flips != NULL);
+  const checksum *ck = track ? g->colkey - 1 : NULL;
+  unsigned char *above = g->rowbuf[0];
+  unsigned char *here = g->rowbuf[1];
+  unsigned char *below, *row, *tmp;
+  unsigned int *fl = NULL;
+  int i, j, i0, i1, n, v, d, rowcell, rowflip;
+  checksum hash, rowsum;
+  long localncell, nflip;
+  size_t start, len;
+
+  localncell = 0;
+  hash = 0;
+  nflip = 0;
+
+  for (j=1; j <= ly; j++)
+    {
+      above[j] = (unsigned char) g->halo[STRIP_UP][j-1];
+      g->rowbuf[2][j] = (unsigned char) g->halo[STRIP_DOWN][j-1];
+    }
+
+  if (maprange(g, 1, nband, 0, &start, &len))
+    madvise(g->map + start, len, MADV_WILLNEED);
+
+  for (i0=1; i0 <= lx; i0 += nband)
+    {
+      i1 = (i0+nband-1 < lx) ? i0+nband-1 : lx;
+
+      if (maprange(g, i1+1, i1+nband, 0, &start, &len))
+        madvise(g->map + start, len, MADV_WILLNEED);
+
+      for (i=i0; i <= i1; i++)
+        {
+          row = mappedrow(g, i);
+          below = (i < lx) ? mappedrow(g, i+1) - 1 : g->rowbuf[2];
+
+          here[0] = (unsigned char) g->halo[STRIP_LEFT][i-1];
+          memcpy(here+1, row, ly);
+          here[ly+1] = (unsigned char) g->halo[STRIP_RIGHT][i-1];
+
+          rowsum = 0;
+          rowflip = 0;
+          rowcell = 0;
+          if (count) fl = g->flips + (size_t) (i-1)*ly - 1;
+
+          for (j=1; j <= ly; j++)
+            {
+              n = above[j] + here[j-1] + here[j] + here[j+1] + below[j];
+              v = (n == 5 || n == 4 || n == 2);
+
+              if (track) rowsum += flipkey(here[j], v, ck[j]);
+
+              if (count)
+                {
+                  d = here[j] ^ v;
+                  fl[j] += d;
+                  rowflip += d;
+                }
+
+              row[j-1] = (unsigned char) v;
+              rowcell += v;
+            }
+
+          if (track) hash += rowhash(g->x0+i-1)*rowsum;
+          nflip += rowflip;
+          localncell += rowcell;
+
+          // the strips sent next step
+
+          g->strip[STRIP_LEFT][i-1] = row[0];
+          g->strip[STRIP_RIGHT][i-1] = row[ly-1];
+
+          for (j=0; j < ly && (i == 1 || i == lx); j++)
+            {
+              if (i == 1)  g->strip[STRIP_UP][j] = row[j];
+              if (i == lx) g->strip[STRIP_DOWN][j] = row[j];
+            }
+
+          tmp = above;
+          above = here;
+          here = tmp;
+        }
+
+      if (!stream) continue;
+
+      if (maprange(g, i0, i1, 1, &start, &len))
+        posix_fadvise(g->mapfd, start, len, POSIX_FADV_DONTNEED);
+
+      if (maprange(g, i0-nband, i0-1, 1, &start, &len))
+        {
+          madvise(g->map + start, len, MADV_DONTNEED);
+          posix_fadvise(g->mapfd, start, len, POSIX_FADV_DONTNEED);
+        }
+    }
+
+  g->rowbuf[0] = above;
+  g->rowbuf[1] = here;
+
+  g->hash += hash;
+  g->nflip = nflip;
+
+  return localncell;
+}
+
+/*
+ *  Update every interior cell once and return the number of living
+ *  cells in the interior.
+ */
+
+static long stepcells(grid *g)
+{
+  int i, j, b, val, d, sparse, rowcell;
+  long localncell;
+  checksum hash, bhash;
+  long nflip, bflip, nsparse;
+
+  localncell = 0;
+  hash = 0;
+  nflip = 0;
+  nsparse = 0;
+
+  if (g->layout == GRID_TILED)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for private(bhash, bflip, sparse) reduction(+:localncell,hash,nflip,nsparse) schedule(static)
+#endif
+      for (b=0; b < g->nbx*g->nby; b++)
+        {
+          localncell += updateblock(g, b/g->nby, b%g->nby, &bhash, &bflip, &sparse);
+          if (g->track) hash += bhash;
+          nflip += bflip;
+          nsparse += sparse;
+        }
+
+      g->hash += hash;
+      g->nflip = nflip;
+      g->nsparse += nsparse;
+      g->nupdate += g->nbx*g->nby;
+
+      swapblocks(g);
+
+      return localncell;
+    }
+
+  if (g->layout == GRID_MAPPED) return stepmapped(g);
+
+  /*
+   *  The plain update is a kernel specialised on the width, in one
+   *  pass, or the generic two-pass loops. Tracking and counting flips
+   *  follow the sums with the loop below.
+   */
+
+  if (!g->track && g->flips == NULL)
+    {
+      if (g->kernel != NULL) return g->kernel(g->cell, g->lx);
+
+      return kerneltwopass(g->cell, g->neigh, g->lx, g->ly);
+    }
+
+  int **cell = g->cell;
+  int **neigh = g->neigh;
+  int lx = g->lx;
+  int ly = g->ly;
+
+  kernelsum(cell, neigh, lx, ly);
+
+  /*
+   *  Update following the cells that flip. The flags are copied to
+   *  locals so that the compiler can see they are constant and hoist
+   *  the tests out of the loops.
+   */
+
+  const int track = g->track;
+  const int count = (g->flips != NULL);
+  const checksum *ck = track ? g->colkey - 1 : NULL;
+  unsigned int *fl = NULL;
+  checksum rowsum;
+  int rowflip;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j, val, d, rowsum, rowflip, rowcell, fl) reduction(+:localncell,hash,nflip) schedule(static)
+#endif
+  for (i=1; i<=lx; i++)
+    {
+      rowsum = 0;
+      rowflip = 0;
+      rowcell = 0;
+      if (count) fl = g->flips + (size_t) (i-1)*ly - 1;
+
+      for (j=1; j<=ly; j++)
+        {
+          val = (neigh[i][j] == 5 || neigh[i][j] == 4 || neigh[i][j] == 2);
+
+          if (track) rowsum += flipkey(cell[i][j], val, ck[j]);
+
+          if (count)
+            {
+              d = cell[i][j] ^ val;
+              fl[j] += d;
+              rowflip += d;
+            }
+
+          cell[i][j] = val;
+          rowcell += val;
+        }
+
+      hash += rowhash(g->x0+i-1)*rowsum;
+      nflip += rowflip;
+      localncell += rowcell;
+    }
+
+  g->hash += hash;
+  g->nflip = nflip;
+
+  return localncell;
+}
+
+/*
+ *  Update every interior cell once and return the number of living
+ *  cells in the interior. The time taken is added to g->tstep.
+ */
+
+long gridstep(grid *g)
+{
+  double t = MPI_Wtime();
+  long localncell = stepcells(g);
+
+  g->tstep += MPI_Wtime() - t;
+
+  return localncell;
+}
+
+/*
+ *  Halo strips a block of the tiled layout reads, as a mask of
+ *  1 << STRIP_UP etc.; zero for blocks inside the tile
+ */
+
+static int blockhalos(grid *g, int b)
+{
+  int bi = b/g->nby;
+  int bj = b%g->nby;
+  int need = 0;
+
+  if (bi == 0)        need |= 1 << STRIP_UP;
+  if (bi == g->nbx-1) need |= 1 << STRIP_DOWN;
+  if (bj == 0)        need |= 1 << STRIP_LEFT;
+  if (bj == g->nby-1) need |= 1 << STRIP_RIGHT;
+
+  return need;
+}
+
+/*
+ *  Swap halos and update the tiled layout as a set of block tasks
+ *  instead of one after the other: the blocks inside the tile, which
+ *  need no halo, are updated while the halos are in flight, and each
+ *  block on the edge is updated as soon as the last halo strip it
+ *  reads has arrived. Messages go to the neighbours only, so a process
+ *  waits for no-one else. Returns the number of living cells.
+ */
+
+long gridstepasync(grid *g, MPI_Comm comm, int up, int down, int left, int right)
+{
+  MPI_Request send[4], recv[4];
+  double t;
+  int neighbour[4];
+  int s, k, b, n, bit, mask, sparse;
+  checksum hash, bhash;
+  long localncell, nflip, bflip, nsparse;
+
+  neighbour[STRIP_UP] = up;
+  neighbour[STRIP_DOWN] = down;
+  neighbour[STRIP_LEFT] = left;
+  neighbour[STRIP_RIGHT] = right;
+
+  countbytes(g, up, down, left, right);
+
+  /*
+   *  Strip s goes to the neighbour on side s, where it is the halo on
+   *  the opposite side, s^1; the tags tell the two apart when both
+   *  neighbours are the same process
+   */
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+      MPI_Irecv(g->halo[s], n, MPI_INT, neighbour[s], ASYNCTAG+s, comm,
+                &recv[s]);
+    }
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+      MPI_Isend(g->strip[s], n, MPI_INT, neighbour[s], ASYNCTAG+(s^1), comm,
+                &send[s]);
+    }
+
+  localncell = 0;
+  hash = 0;
+  nflip = 0;
+  nsparse = 0;
+
+  // only the updates are timed, not the waits for the neighbours
+
+  t = MPI_Wtime();
+
+#ifdef _OPENMP
+#pragma omp parallel for private(bhash, bflip, sparse) reduction(+:localncell,hash,nflip,nsparse) schedule(dynamic)
+#endif
+  for (b=0; b < g->nbx*g->nby; b++)
+    {
+      if (blockhalos(g, b) != 0) continue;
+
+      localncell += updateblock(g, b/g->nby, b%g->nby, &bhash, &bflip, &sparse);
+      if (g->track) hash += bhash;
+      nflip += bflip;
+      nsparse += sparse;
+    }
+
+  g->tstep += MPI_Wtime() - t;
+
+  // the edge blocks overwrite the strips being sent
+
+  MPI_Waitall(4, send, MPI_STATUSES_IGNORE);
+
+  mask = 0;
+
+  for (k=0; k < 4; k++)
+    {
+      MPI_Waitany(4, recv, &s, MPI_STATUS_IGNORE);
+
+      bit = 1 << s;
+      mask |= bit;
+
+      t = MPI_Wtime();
+
+#ifdef _OPENMP
+#pragma omp parallel for private(bhash, bflip, sparse) reduction(+:localncell,hash,nflip,nsparse) schedule(dynamic)
+#endif
+      for (b=0; b < g->nbx*g->nby; b++)
+        {
+          int need = blockhalos(g, b);
+
+          if (!(need & bit) || (need & ~mask) != 0) continue;
+
+          localncell += updateblock(g, b/g->nby, b%g->nby, &bhash, &bflip, &sparse);
+          if (g->track) hash += bhash;
+          nflip += bflip;
+          nsparse += sparse;
+        }
+
+      g->tstep += MPI_Wtime() - t;
+    }
+
+  g->hash += hash;
+  g->nflip = nflip;
+  g->nsparse += nsparse;
+  g->nupdate += g->nbx*g->nby;
+
+  swapblocks(g);
+
+  return localncell;
+}
+
+/*
+ *  Segment of side s that block (bi, bj) sends and receives, or -1 if
+ *  it is not on that edge of the tile
+ */
+
+static int aheadsegment(grid *g, int s, int bi, int bj)
+{
+  switch (s)
+    {
+    case STRIP_UP:    return (bi == 0)        ? bj : -1;
+    case STRIP_DOWN:  return (bi == g->nbx-1) ? bj : -1;
+    case STRIP_LEFT:  return (bj == 0)        ? bi : -1;
+    default:          return (bj == g->nby-1) ? bi : -1;
+    }
+}
+
+/*
+ *  Offset and length of segment k in a strip of side s
+ */
+
+static void aheadrange(grid *g, int s, int k, int *offset, int *n)
+{
+  int nx, ny;
+
+  if (s < STRIP_LEFT)
+    {
+      blocksize(g, 0, k, &nx, &ny);
+      *offset = k*GRIDBY;
+      *n = ny;
+    }
+  else
+    {
+      blocksize(g, k, 0, &nx, &ny);
+      *offset = k*GRIDBX;
+      *n = nx;
+    }
+}
+
+static gridahead *aheadcreate(grid *g, int ahead)
+{
+  gridahead *a;
+  int nb = g->nbx*g->nby;
+  int s, n;
+
+  a = (gridahead *) calloc(1, sizeof(gridahead));
+
+  a->step = (long *) malloc(nb*sizeof(long));
+  a->rcell = (int *) malloc(nb*sizeof(int));
+  a->rhash = (checksum *) malloc(nb*sizeof(checksum));
+  a->rflip = (long *) malloc(nb*sizeof(long));
+
+  a->nring = ahead + 2;
+  a->ncell = (long *) calloc(a->nring, sizeof(long));
+  a->nflip = (long *) calloc(a->nring, sizeof(long));
+  a->ndone = (int *) calloc(a->nring, sizeof(int));
+
+  a->seg[0] = 0;
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+      a->strip[1][s] = (int *) calloc(n, sizeof(int));
+      a->halo[1][s] = (int *) calloc(n, sizeof(int));
+
+      a->seg[s+1] = a->seg[s] + 2*((s < STRIP_LEFT) ? g->nby : g->nbx);
+    }
+
+  // the list of ready blocks doubles as the indices of Testsome
+
+  a->ready = (int *) malloc((nb > a->seg[4] ? nb : a->seg[4])*sizeof(int));
+  a->recv = (MPI_Request *) malloc(a->seg[4]*sizeof(MPI_Request));
+  a->send = (MPI_Request *) malloc(a->seg[4]*sizeof(MPI_Request));
+  a->want = (long *) malloc(a->seg[4]*sizeof(long));
+  a->have = (long *) malloc(a->seg[4]*sizeof(long));
+
+  for (n=0; n < a->seg[4]; n++)
+    {
+      a->recv[n] = MPI_REQUEST_NULL;
+      a->send[n] = MPI_REQUEST_NULL;
+    }
+
+  return a;
+}
+
+static void aheadfree(gridahead *a)
+{
+  int s;
+
+  for (s=0; s < 4; s++)
+    {
+      free(a->strip[1][s]);
+      free(a->halo[1][s]);
+    }
+
+  free(a->step);
+  free(a->ready);
+  free(a->rcell);
+  free(a->rhash);
+  free(a->rflip);
+  free(a->ncell);
+  free(a->nflip);
+  free(a->ndone);
+  free(a->recv);
+  free(a->send);
+  free(a->want);
+  free(a->have);
+  free(a);
+}
+
+/*
+ *  Post the receive of the halo of step t for segment k of side s
+ */
+
+static void aheadrecv(grid *g, MPI_Comm comm, int s, int k, long t,
+                      int neighbour)
+{
+  gridahead *a = g->ahead;
+  int p = (int) ((t - a->t0) % 2);
+  int r = a->seg[s] + 2*k + p;
+  int offset, n;
+
+  aheadrange(g, s, k, &offset, &n);
+
+  a->want[r] = t;
+  a->have[r] = -1;
+
+  MPI_Irecv(a->halo[p][s] + offset, n, MPI_INT, neighbour, AHEADTAG + 4*k + s,
+            comm, &a->recv[r]);
+}
+
+/*
+ *  Send segment k of the strip of side s at step t; on the neighbour
+ *  it is segment k of the halo on the opposite side
+ */
+
+static void aheadsend(grid *g, MPI_Comm comm, int s, int k, long t,
+                      int neighbour)
+{
+  gridahead *a = g->ahead;
+  int p = (int) ((t - a->t0) % 2);
+  int offset, n;
+
+  aheadrange(g, s, k, &offset, &n);
+
+  MPI_Isend(a->strip[p][s] + offset, n, MPI_INT, neighbour,
+            AHEADTAG + 4*k + (s^1), comm, &a->send[a->seg[s] + 2*k + p]);
+
+  g->halobytes[s] += n*sizeof(int);
+}
+
+/*
+ *  Record the halo segments that have arrived, waiting for at least
+ *  one if wait is set
+ */
+
+static void aheadarrived(gridahead *a, int wait)
+{
+  int *index = a->ready; // free between rounds
+  int k, n;
+
+  if (wait)
+    MPI_Waitsome(a->seg[4], a->recv, &n, index, MPI_STATUSES_IGNORE);
+  else
+    MPI_Testsome(a->seg[4], a->recv, &n, index, MPI_STATUSES_IGNORE);
+
+  if (n == MPI_UNDEFINED) return;
+
+  for (k=0; k < n; k++)
+    {
+      a->have[index[k]] = a->want[index[k]];
+    }
+}
+
+/*
+ *  Can block b go from step t to t+1: its neighbours inside the tile
+ *  have reached t, and so have the halo segments it reads
+ */
+
+static int aheadready(grid *g, int b, long t, const int *neighbour)
+{
+  gridahead *a = g->ahead;
+  int bi = b/g->nby;
+  int bj = b%g->nby;
+  int p = (int) ((t - a->t0) % 2);
+  int s, k;
+
+  if (bi > 0        && a->step[b-g->nby] < t) return 0;
+  if (bi < g->nbx-1 && a->step[b+g->nby] < t) return 0;
+  if (bj > 0        && a->step[b-1] < t) return 0;
+  if (bj < g->nby-1 && a->step[b+1] < t) return 0;
+
+  for (s=0; s < 4; s++)
+    {
+      k = aheadsegment(g, s, bi, bj);
+
+      if (k >= 0 && neighbour[s] != MPI_PROC_NULL &&
+          a->have[a->seg[s] + 2*k + p] != t)
+        {
+          return 0;
+        }
+    }
+
+  return 1;
+}
+
+/*
+ *  Update the tiled layout with the blocks running ahead of each
+ *  other, and return the number of living cells on step once every
+ *  block has reached it.
+ *
+ *  A block goes from t to t+1 as soon as its neighbours in the tile
+ *  have reached t and the halo segments it reads for t have arrived,
+ *  but never more than ahead steps beyond the slowest block, nor
+ *  beyond cap. Its new boundary segments are sent straight away, so
+ *  edge blocks on neighbouring processes follow each other segment by
+ *  segment and a slow process or core holds up only the blocks next
+ *  to it, while the others run on. Two copies of each block, strip
+ *  and halo suffice: a block can be at most one step ahead of any
+ *  block it reads, here or on another process.
+ *
+ *  Between step and cap the blocks may be at different steps, so the
+ *  cells must not be read; when step reaches cap they are all level
+ *  again, in g->block, with no messages in flight. The first call
+ *  after that must come with the blocks level at step-1. The cap can
+ *  be lowered on the way, but not below low+ahead, the furthest any
+ *  block may have gone. Tiled dense engine only.
+ */
+
+long gridstepahead(grid *g, MPI_Comm comm, int up, int down, int left, int right,
+                   long step, int ahead, long cap)
+{
+  gridahead *a;
+  int *tmp;
+  int **btmp;
+  double t;
+  int neighbour[4];
+  int nb = g->nbx*g->nby;
+  int b, r, s, k, p, n, bi, bj;
+  long bt, ncell;
+
+  neighbour[STRIP_UP] = up;
+  neighbour[STRIP_DOWN] = down;
+  neighbour[STRIP_LEFT] = left;
+  neighbour[STRIP_RIGHT] = right;
+
+  if (g->ahead == NULL) g->ahead = aheadcreate(g, ahead);
+
+  a = g->ahead;
+
+  if (a->active && cap < a->cap) a->cap = cap;
+
+  /*
+   *  The blocks are level at step-1: swap the halos of that step and
+   *  post the receives of the next one
+   */
+
+  if (!a->active)
+    {
+      a->active = 1;
+      a->t0 = step-1;
+      a->low = step-1;
+      a->cap = cap;
+
+      a->buf[0] = g->block;
+      a->buf[1] = g->next;
+
+      for (s=0; s < 4; s++)
+        {
+          n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+          a->strip[0][s] = g->strip[s];
+          a->halo[0][s] = g->halo[s];
+
+          // the fixed boundary is the same on every step
+
+          memcpy(a->halo[1][s], g->halo[s], n*sizeof(int));
+        }
+
+      for (b=0; b < nb; b++)
+        {
+          a->step[b] = a->t0;
+        }
+
+      for (r=0; r < a->seg[4]; r++)
+        {
+          a->have[r] = -1;
+        }
+
+      for (s=0; s < 4; s++)
+        {
+          if (neighbour[s] == MPI_PROC_NULL) continue;
+
+          for (k=0; k < (a->seg[s+1] - a->seg[s])/2; k++)
+            {
+              aheadrecv(g, comm, s, k, a->t0, neighbour[s]);
+              if (a->t0+1 < cap) aheadrecv(g, comm, s, k, a->t0+1, neighbour[s]);
+            }
+        }
+
+      for (s=0; s < 4; s++)
+        {
+          if (neighbour[s] == MPI_PROC_NULL) continue;
+
+          for (k=0; k < (a->seg[s+1] - a->seg[s])/2; k++)
+            {
+              aheadsend(g, comm, s, k, a->t0, neighbour[s]);
+            }
+        }
+    }
+
+  while (a->low < step)
+    {
+      /*
+       *  Blocks that can go ahead now
+       */
+
+      aheadarrived(a, 0);
+
+      n = 0;
+
+      for (b=0; b < nb; b++)
+        {
+          bt = a->step[b];
+
+          if (bt < a->cap && bt < a->low + ahead && aheadready(g, b, bt, neighbour))
+            {
+              a->ready[n++] = b;
+            }
+        }
+
+      if (n == 0)
+        {
+          aheadarrived(a, 1);
+          continue;
+        }
+
+      // the strips they write must have been sent
+
+      for (r=0; r < n; r++)
+        {
+          b = a->ready[r];
+          p = (int) ((a->step[b] + 1 - a->t0) % 2);
+
+          for (s=0; s < 4; s++)
+            {
+              k = aheadsegment(g, s, b/g->nby, b%g->nby);
+              if (k >= 0) MPI_Wait(&a->send[a->seg[s] + 2*k + p], MPI_STATUS_IGNORE);
+            }
+        }
+
+      t = MPI_Wtime();
+
+#ifdef _OPENMP
+#pragma omp parallel for private(b, p) schedule(dynamic)
+#endif
+      for (r=0; r < n; r++)
+        {
+          b = a->ready[r];
+          p = (int) ((a->step[b] - a->t0) % 2);
+
+          a->rcell[r] = stepblock(g, a->buf[p], a->buf[1-p], a->halo[p],
+                                  a->strip[1-p], b/g->nby, b%g->nby,
+                                  &a->rhash[r], &a->rflip[r]);
+        }
+
+      g->tstep += MPI_Wtime() - t;
+
+      /*
+       *  Count the new step of each block, send its boundary and
+       *  receive into the halo slot it has finished with
+       */
+
+      for (r=0; r < n; r++)
+        {
+          b = a->ready[r];
+          bi = b/g->nby;
+          bj = b%g->nby;
+          bt = ++a->step[b];
+
+          k = (int) (bt % a->nring);
+          a->ncell[k] += a->rcell[r];
+          a->nflip[k] += a->rflip[r];
+          a->ndone[k]++;
+
+          if (g->track) g->hash += a->rhash[r];
+
+          for (s=0; s < 4; s++)
+            {
+              k = aheadsegment(g, s, bi, bj);
+
+              if (k < 0 || neighbour[s] == MPI_PROC_NULL) continue;
+
+              if (bt < a->cap) aheadsend(g, comm, s, k, bt, neighbour[s]);
+              if (bt+1 < a->cap) aheadrecv(g, comm, s, k, bt+1, neighbour[s]);
+            }
+        }
+
+      while (a->low < step && a->ndone[(a->low+1) % a->nring] == nb)
+        {
+          a->low++;
+        }
+    }
+
+  k = (int) (step % a->nring);
+
+  ncell = a->ncell[k];
+  g->nflip = a->nflip[k];
+  g->nupdate += nb;
+
+  a->ncell[k] = 0;
+  a->nflip[k] = 0;
+  a->ndone[k] = 0;
+
+  /*
+   *  Level at cap: leave the cells in g->block and the strips in
+   *  g->strip, as after gridstep
+   */
+
+  if (step == a->cap)
+    {
+      MPI_Waitall(a->seg[4], a->send, MPI_STATUSES_IGNORE);
+
+      if ((a->cap - a->t0) % 2 == 1)
+        {
+          btmp = g->block;
+          g->block = g->next;
+          g->next = btmp;
+
+          for (s=0; s < 4; s++)
+            {
+              tmp = g->strip[s];
+              g->strip[s] = a->strip[1][s];
+              a->strip[1][s] = tmp;
+            }
+        }
+
+      a->active = 0;
+    }
+
+  return ncell;
+}
+
+/*
+ *  Start following the fingerprint of the local interior in g->hash.
+ *  The origin x0, y0 must be set first.
+ */
+
+void gridtrack(grid *g)
+{
+  int j;
+
+  if (g->colkey == NULL)
+    {
+      g->colkey = (checksum *) malloc(g->ly*sizeof(checksum));
+    }
+
+  for (j=1; j <= g->ly; j++)
+    {
+      g->colkey[j-1] = colhash(g->y0+j-1);
+    }
+
+  g->hash = gridchecksum(g);
+  g->track = 1;
+}
+
+/*
+ *  Start counting the cells that flip in g->nflip and g->flips
+ */
+
+void gridflips(grid *g)
+{
+  if (g->flips == NULL)
+    {
+      g->flips = (unsigned int *) calloc((size_t) g->lx*g->ly,
+                                         sizeof(unsigned int));
+    }
+
+  g->nflip = 0;
+}
+
+/*
+ *  Switch the tiled layout to GRID_SPARSE. A block is only listed
+ *  once it has been updated in full.
+ */
+
+void gridsparse(grid *g)
+{
+  int nb = g->nbx*g->nby;
+  int b, s, n;
+
+  if (g->layout != GRID_TILED || g->nlive != NULL) return;
+
+  g->nlive = (int *) malloc(nb*sizeof(int));
+  g->nlivenext = (int *) malloc(nb*sizeof(int));
+  g->live = (unsigned short **) arraymalloc2d(nb, SPARSEMAX, sizeof(unsigned short));
+  g->livenext = (unsigned short **) arraymalloc2d(nb, SPARSEMAX, sizeof(unsigned short));
+
+  for (b=0; b < nb; b++)
+    {
+      g->nlive[b] = -1;
+      g->nlivenext[b] = -1;
+    }
+
+  for (s=0; s < 4; s++)
+    {
+      n = (s < STRIP_LEFT) ? g->ly : g->lx;
+
+      g->stripsend[s] = (int *) malloc((n+1)*sizeof(int));
+      g->striprecv[s] = (int *) malloc((n+1)*sizeof(int));
+    }
+}
+
+/*
+ *  Fingerprint of the local interior computed from scratch
+ */
+
+checksum gridchecksum(grid *g)
+{
+  checksum hash = 0;
+  int *row;
+  int i, j;
+
+  row = (int *) malloc(g->ly*sizeof(int));
+
+  for (i=1; i <= g->lx; i++)
+    {
+      gridgetrow(g, i, row);
+
+      for (j=1; j <= g->ly; j++)
+        {
+          if (row[j-1]) hash += cellhash(g->x0+i-1, g->y0+j-1);
+        }
+    }
+
+  free(row);
+
+  return hash;
+}
+
+/*
+ *  Number of living cells in the interior
+ */
+
+long gridcount(grid *g)
+{
+  int *row;
+  int i, j;
+  long n;
+
+  row = (int *) malloc(g->ly*sizeof(int));
+  n = 0;
+
+  for (i=1; i <= g->lx; i++)
+    {
+      gridgetrow(g, i, row);
+
+      for (j=0; j < g->ly; j++)
+        {
+          n += row[j];
+        }
+    }
+
+  free(row);
+
+  return n;
+}
+
+/*
+ *  Copy the interior to or from buf, one byte per cell, row-major
+ *  (cell (i, j) at buf[(i-1)*ly + j-1])
+ */
+
+void gridgetbytes(grid *g, unsigned char *buf)
+{
+  int *row;
+  int i, j;
+
+  row = (int *) malloc(g->ly*sizeof(int));
+
+  for (i=1; i <= g->lx; i++)
+    {
+      gridgetrow(g, i, row);
+
+      for (j=0; j < g->ly; j++)
+        {
+          buf[(size_t) (i-1)*g->ly + j] = (unsigned char) row[j];
+        }
+    }
+
+  free(row);
+}
+
+void gridsetbytes(grid *g, const unsigned char *buf)
+{
+  int *row;
+  int i, j;
+
+  row = (int *) malloc(g->ly*sizeof(int));
+
+  for (i=1; i <= g->lx; i++)
+    {
+      for (j=0; j < g->ly; j++)
+        {
+          row[j] = buf[(size_t) (i-1)*g->ly + j];
+        }
+
+      gridsetrow(g, i, row);
+    }
+
+  free(row);
+}
+
+/*
+ *  Committed datatype selecting this tile from a global L x L array
+ *  of etype stored row-major, for use as an MPI-IO file view
+ */
+
+MPI_Datatype gridfiletype(grid *g, MPI_Datatype etype)
+{
+  MPI_Datatype filetype;
+  int sizes[2] = {L, L};
+  int subsizes[2] = {g->lx, g->ly};
+  int starts[2] = {g->x0, g->y0};
+
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, etype,
+                           &filetype);
+  MPI_Type_commit(&filetype);
+
+  return filetype;
+}
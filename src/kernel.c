@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kernel.h"
+
+/*
+ *  Set neigh[i][j] to be the sum of cell[i][j] plus its four nearest
+ *  neighbours
+ */
+
+void kernelsum(int **cell, int **neigh, int lx, int ly)
+{
+  int i, j;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(static)
+#endif
+  for (i=1; i<=lx; i++)
+    {
+      for (j=1; j<=ly; j++)
+        {
+          neigh[i][j] =   cell[i][j]
+                        + cell[i][j+1]
+                        + cell[i][j-1]
+                        + cell[i+1][j]
+                        + cell[i-1][j];
+        }
+    }
+}
+
+/*
+ *  The original update: all the sums into neigh, then the rule
+ */
+
+long kerneltwopass(int **cell, int **neigh, int lx, int ly)
+{
+  int i, j, rowcell;
+  long ncell;
+
+  kernelsum(cell, neigh, lx, ly);
+
+  ncell = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j, rowcell) reduction(+:ncell) schedule(static)
+#endif
+  for (i=1; i<=lx; i++)
+    {
+      rowcell = 0;
+
+      for (j=1; j<=ly; j++)
+        {
+          /*
+           * Udate based on number of neighbours
+           */
+
+          if (neigh[i][j] == 5 || neigh[i][j] == 4 || neigh[i][j] == 2)
+            {
+              cell[i][j] = 1;
+              rowcell++;
+            }
+          else
+            {
+              cell[i][j] = 0;
+            }
+        }
+
+      ncell += rowcell;
+    }
+
+  return ncell;
+}
+
+/*
+ *  Rows i0 ... i1 of the lx rows, as this thread's share of a static
+ *  schedule
+ */
+
+static void rowrange(int lx, int *i0, int *i1)
+{
+#ifdef _OPENMP
+  int chunk = (lx + omp_get_num_threads() - 1)/omp_get_num_threads();
+
+  *i0 = 1 + omp_get_thread_num()*chunk;
+  *i1 = (*i0 + chunk - 1 < lx) ? *i0 + chunk - 1 : lx;
+#else
+  *i0 = 1;
+  *i1 = lx;
+#endif
+}
+
+/*
+ *  Update rows i0 ... i1 of a row-major tile of width w in one pass,
+ *  without neigh. Each row is copied before it is overwritten and the
+ *  copy of the row above is kept, so the sums read old values; the
+ *  rows either side of the range are copied before any thread starts
+ *  writing. save holds 3*(w+2) ints. Inlined with w a constant, the
+ *  row loop has a fixed trip count that the compiler can unroll and
+ *  vectorise without a remainder.
+ */
+
+static inline long steprange(int **cell, const int w, int i0, int i1, int *save)
+{
+  int *above = save;
+  int *here  = save + (w+2);
+  int *below = save + 2*(w+2);
+  int *row, *tmp;
+  const int *down;
+  int i, j, n, v, rowcell;
+  long ncell;
+
+  if (i0 <= i1)
+    {
+      memcpy(above, cell[i0-1], (w+2)*sizeof(int));
+      memcpy(below, cell[i1+1], (w+2)*sizeof(int));
+    }
+
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+
+  ncell = 0;
+
+  for (i=i0; i <= i1; i++)
+    {
+      row = cell[i];
+      down = (i < i1) ? cell[i+1] : below;
+
+      memcpy(here, row, (w+2)*sizeof(int));
+      rowcell = 0;
+
+      for (j=1; j <= w; j++)
+        {
+          n = here[j-1] + here[j] + here[j+1] + above[j] + down[j];
+
+          v = (n == 5 || n == 4 || n == 2);
+          row[j] = v;
+          rowcell += v;
+        }
+
+      ncell += rowcell;
+
+      tmp = above;
+      above = here;
+      here = tmp;
+    }
+
+  return ncell;
+}
+
+#ifdef _OPENMP
+#define STEPREGION _Pragma("omp parallel reduction(+:ncell)")
+#else
+#define STEPREGION
+#endif
+
+#define STEPWIDTH(W) \
+static long stepwidth##W(int **cell, int lx) \
+{ \
+  long ncell = 0; \
+  STEPREGION \
+  { \
+    int save[3*(W+2)]; \
+    int i0, i1; \
+    rowrange(lx, &i0, &i1); \
+    ncell += steprange(cell, W, i0, i1, save); \
+  } \
+  return ncell; \
+}
+
+STEPWIDTH(960)
+STEPWIDTH(480)
+STEPWIDTH(320)
+STEPWIDTH(240)
+STEPWIDTH(192)
+STEPWIDTH(160)
+STEPWIDTH(120)
+STEPWIDTH(96)
+STEPWIDTH(80)
+STEPWIDTH(64)
+STEPWIDTH(60)
+STEPWIDTH(48)
+
+#undef STEPWIDTH
+#undef STEPREGION
+
+/*
+ *  Widths L/py of the process grids MPI_Dims_create gives for up to a
+ *  few hundred processes
+ */
+
+static const struct
+{
+  int ly;
+  long (*kernel)(int **cell, int lx);
+} widthkernel[] =
+  {
+    {960, stepwidth960}, {480, stepwidth480}, {320, stepwidth320},
+    {240, stepwidth240}, {192, stepwidth192}, {160, stepwidth160},
+    {120, stepwidth120}, { 96, stepwidth96 }, { 80, stepwidth80 },
+    { 64, stepwidth64 }, { 60, stepwidth60 }, { 48, stepwidth48 }
+  };
+
+/*
+ *  Kernel specialised on the width of the tile, or NULL if there is
+ *  none and the generic update is used
+ */
+
+long (*kernelwidth(int ly))(int **cell, int lx)
+{
+  int k;
+
+  for (k=0; k < (int) (sizeof(widthkernel)/sizeof(widthkernel[0])); k++)
+    {
+      if (widthkernel[k].ly == ly) return widthkernel[k].kernel;
+    }
+
+  return NULL;
+}
+
+/*
+ *  One-pass update of any width, with the width left to run time
+ */
+
+long kernelfused(int **cell, int lx, int ly)
+{
+  long ncell = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel reduction(+:ncell)
+#endif
+  {
+    int *save = (int *) malloc(3*(ly+2)*sizeof(int));
+    int i0, i1;
+
+    rowrange(lx, &i0, &i1);
+    ncell += steprange(cell, ly, i0, i1, save);
+
+    free(save);
+  }
+
+  return ncell;
+}
+
+/*
+ *  Copy columns 1 and ly into l and r. With SSE2, four rows at a time:
+ *  the first and last four cells of each row are loaded as vectors and
+ *  transposed, keeping one lane per row, so four cells of each column
+ *  are stored with one vector store. Needs ly >= 4 for the loads to
+ *  stay inside the row.
+ */
+
+void kernelpackcolumns(int **cell, int lx, int ly, int *l, int *r)
+{
+  int i = 1;
+
+#ifdef __SSE2__
+  __m128i a, b, c, d;
+
+  if (ly >= 4)
+    {
+      for (; i+3 <= lx; i += 4)
+        {
+          // lane 0 of cells 1 ... 4 is column 1
+
+          a = _mm_loadu_si128((const __m128i *) &cell[i][1]);
+          b = _mm_loadu_si128((const __m128i *) &cell[i+1][1]);
+          c = _mm_loadu_si128((const __m128i *) &cell[i+2][1]);
+          d = _mm_loadu_si128((const __m128i *) &cell[i+3][1]);
+
+          _mm_storeu_si128((__m128i *) &l[i-1],
+                           _mm_unpacklo_epi64(_mm_unpacklo_epi32(a, b),
+                                              _mm_unpacklo_epi32(c, d)));
+
+          // lane 3 of cells ly-3 ... ly is column ly
+
+          a = _mm_loadu_si128((const __m128i *) &cell[i][ly-3]);
+          b = _mm_loadu_si128((const __m128i *) &cell[i+1][ly-3]);
+          c = _mm_loadu_si128((const __m128i *) &cell[i+2][ly-3]);
+          d = _mm_loadu_si128((const __m128i *) &cell[i+3][ly-3]);
+
+          _mm_storeu_si128((__m128i *) &r[i-1],
+                           _mm_unpackhi_epi64(_mm_unpackhi_epi32(a, b),
+                                              _mm_unpackhi_epi32(c, d)));
+        }
+    }
+#endif
+
+  for (; i <= lx; i++)
+    {
+      l[i-1] = cell[i][1];
+      r[i-1] = cell[i][ly];
+    }
+}
+
+/*
+ *  Copy c into halo column j: one store per row, which no vector
+ *  instruction of SSE2 can combine
+ */
+
+void kernelunpackcolumn(int **cell, int lx, int j, const int *c)
+{
+  int i;
+
+  for (i=1; i <= lx; i++)
+    {
+      cell[i][j] = c[i-1];
+    }
+}
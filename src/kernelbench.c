@@ -0,0 +1,347 @@
+/*
+ *  Microbenchmarks of the kernels on one core, without MPI or
+ *  communication (make kernelbench).
+ *
+ *  kernelbench [reps]
+ *
+ *  Synthetic tiles of a range of shapes are filled at density RHO and
+ *  each kernel is timed reps times (default 11) on the same starting
+ *  cells: the row-major updates (the original two-pass loops, the
+ *  one-pass update of any width and the one specialised on the width,
+ *  if there is one), the copy of the halo columns, the generators of
+ *  the initial cells and PBM writing. The median time is reported as
+ *  ns/cell, Mcells/s and GB/s, with the fastest repetition and the
+ *  interquartile range. GB/s counts the bytes per cell the kernel has
+ *  to read and write at least, e.g. 16 for the two-pass update (cell
+ *  and neigh each read and written once) and 8 for the one-pass one.
+ *
+ *  Run it on a quiet core with one thread, e.g.
+ *
+ *    OMP_NUM_THREADS=1 taskset -c 0 ./kernelbench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "automaton.h"
+#include "arraymalloc.h"
+#include "kernel.h"
+#include "rng.h"
+
+#define RHO         0.49     // density of the synthetic tiles
+#define BENCHSEED   1234
+#define BENCHCELLS  20000000 // cells updated per repetition, at least
+#define BENCHFILE   "kernelbench.pbm"
+
+static const int shapes[][2] =
+  {
+    { 96, 192}, {240, 240}, {480, 480}, {960, 960}, {100, 1000}
+  };
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + 1.0e-9*t.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ *  Print one line from the times of reps repetitions of n cells each
+ */
+
+static void report(const char *name, int lx, int ly, double n, double bytes,
+                   double *t, int reps)
+{
+  double med, iqr;
+
+  qsort(t, reps, sizeof(double), compare);
+
+  med = t[reps/2];
+  iqr = t[(3*reps)/4] - t[reps/4];
+
+  printf("%-14s %4d x %-4d %8.3f ns/cell %9.1f Mcells/s %7.2f GB/s"
+         "   min %.3f  iqr %4.1f%%\n",
+         name, lx, ly, 1.0e9*med/n, 1.0e-6*n/med, 1.0e-9*bytes*n/med,
+         1.0e9*t[0]/n, 100.0*iqr/med);
+}
+
+/*
+ *  Fill the interior of an (lx+2) x (ly+2) array at density RHO, the
+ *  halos dead
+ */
+
+static void fill(int **cell, int lx, int ly)
+{
+  rng r;
+  float *x;
+  int i, j;
+
+  x = (float *) malloc(ly*sizeof(float));
+  rngseed(&r, RNG_COUNTER, BENCHSEED);
+
+  for (i=1; i <= lx; i++)
+    {
+      rngfill(&r, x, ly);
+
+      for (j=1; j <= ly; j++)
+        {
+          cell[i][j] = (x[j-1] < RHO);
+        }
+    }
+
+  free(x);
+}
+
+static void copy(int **to, int **from, int lx, int ly)
+{
+  int i;
+
+  for (i=0; i < lx+2; i++)
+    {
+      memcpy(to[i], from[i], (ly+2)*sizeof(int));
+    }
+}
+
+/*
+ *  The update variants. Returns 1 if they disagree.
+ */
+
+#define UPDATE_TWOPASS 0
+#define UPDATE_FUSED   1
+#define UPDATE_WIDTH   2
+#define UPDATES        3
+
+static int benchupdates(int lx, int ly, int reps)
+{
+  static const char *name[UPDATES] = {"twopass", "fused", "fused-width"};
+  static const double bytes[UPDATES] = {16.0, 8.0, 8.0};
+  long (*width)(int **cell, int lx) = kernelwidth(ly);
+  int **init, **cell, **neigh;
+  double *t, t0;
+  int nstep, u, k, s;
+  long ncell = 0, expect;
+
+  init  = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int), ALIGN, PITCH, HUGEPAGE);
+  cell  = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int), ALIGN, PITCH, HUGEPAGE);
+  neigh = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int), ALIGN, PITCH, HUGEPAGE);
+  t = (double *) malloc(reps*sizeof(double));
+
+  fill(init, lx, ly);
+
+  nstep = (BENCHCELLS + lx*ly - 1)/(lx*ly);
+  expect = -1;
+
+  for (u=0; u < UPDATES; u++)
+    {
+      if (u == UPDATE_WIDTH && width == NULL) continue;
+
+      for (k=0; k < reps; k++)
+        {
+          copy(cell, init, lx, ly);
+
+          t0 = now();
+
+          for (s=0; s < nstep; s++)
+            {
+              if (u == UPDATE_TWOPASS)
+                ncell = kerneltwopass(cell, neigh, lx, ly);
+              else if (u == UPDATE_FUSED)
+                ncell = kernelfused(cell, lx, ly);
+              else
+                ncell = width(cell, lx);
+            }
+
+          t[k] = now() - t0;
+        }
+
+      report(name[u], lx, ly, (double) nstep*lx*ly, bytes[u], t, reps);
+
+      if (expect >= 0 && ncell != expect)
+        {
+          printf("kernelbench: %s leaves %ld living cells instead of %ld\n",
+                 name[u], ncell, expect);
+          return 1;
+        }
+
+      expect = ncell;
+    }
+
+  free(init);
+  free(cell);
+  free(neigh);
+  free(t);
+
+  return 0;
+}
+
+/*
+ *  Copy out columns 1 and ly and copy back into halo columns 0 and
+ *  ly+1, as HALO_MANUAL does: 4*lx cells each read and written once
+ */
+
+static void benchhalo(int lx, int ly, int reps)
+{
+  int **cell;
+  int *l, *r;
+  double *t, t0;
+  int npack, k, s;
+
+  cell = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int), ALIGN, PITCH, HUGEPAGE);
+  l = (int *) malloc(lx*sizeof(int));
+  r = (int *) malloc(lx*sizeof(int));
+  t = (double *) malloc(reps*sizeof(double));
+
+  fill(cell, lx, ly);
+
+  npack = (BENCHCELLS/16 + 4*lx - 1)/(4*lx);
+
+  for (k=0; k < reps; k++)
+    {
+      t0 = now();
+
+      for (s=0; s < npack; s++)
+        {
+          kernelpackcolumns(cell, lx, ly, l, r);
+          kernelunpackcolumn(cell, lx, 0, r);
+          kernelunpackcolumn(cell, lx, ly+1, l);
+        }
+
+      t[k] = now() - t0;
+    }
+
+  report("pack+unpack", lx, ly, (double) npack*4*lx, 8.0, t, reps);
+
+  free(cell);
+  free(l);
+  free(r);
+  free(t);
+}
+
+/*
+ *  Uniform numbers for a tile from each generator, written to a
+ *  buffer
+ */
+
+static void benchrng(int lx, int ly, int reps)
+{
+  static const char *name[2] = {"rng-uni", "rng-counter"};
+  static const int mode[2] = {RNG_UNI, RNG_COUNTER};
+  rng r;
+  float *x;
+  double *t, t0;
+  int m, k;
+
+  x = (float *) malloc((size_t) lx*ly*sizeof(float));
+  t = (double *) malloc(reps*sizeof(double));
+
+  for (m=0; m < 2; m++)
+    {
+      for (k=0; k < reps; k++)
+        {
+          rngseed(&r, mode[m], BENCHSEED);
+
+          t0 = now();
+          rngfill(&r, x, (long) lx*ly);
+          t[k] = now() - t0;
+        }
+
+      report(name[m], lx, ly, (double) lx*ly, 4.0, t, reps);
+    }
+
+  free(x);
+  free(t);
+}
+
+/*
+ *  Write the tile as a PBM file, two characters per cell. The
+ *  messages autowriterect prints go to /dev/null.
+ */
+
+static void benchpbm(int lx, int ly, int reps)
+{
+  int **cell, **rows;
+  double *t, t0;
+  int i, k, out, null;
+
+  cell = (int **) arraymalloc2daligned(lx+2, ly+2, sizeof(int), ALIGN, PITCH, HUGEPAGE);
+  rows = (int **) malloc(lx*sizeof(int *));
+  t = (double *) malloc(reps*sizeof(double));
+
+  fill(cell, lx, ly);
+
+  for (i=0; i < lx; i++)
+    {
+      rows[i] = cell[i+1] + 1;
+    }
+
+  fflush(stdout);
+  out = dup(STDOUT_FILENO);
+  null = open("/dev/null", O_WRONLY);
+
+  for (k=0; k < reps; k++)
+    {
+      dup2(null, STDOUT_FILENO);
+
+      t0 = now();
+      autowriterect(BENCHFILE, rows, lx, ly);
+      t[k] = now() - t0;
+
+      fflush(stdout);
+      dup2(out, STDOUT_FILENO);
+    }
+
+  close(null);
+  close(out);
+  remove(BENCHFILE);
+
+  report("pbm-write", lx, ly, (double) lx*ly, 2.0, t, reps);
+
+  free(cell);
+  free(rows);
+  free(t);
+}
+
+int main(int argc, char *argv[])
+{
+  int reps, k, lx, ly;
+
+  reps = (argc > 1) ? atoi(argv[1]) : 11;
+
+  if (argc > 2 || reps < 1)
+    {
+      printf("Usage: kernelbench [reps]\n");
+      return 1;
+    }
+
+  printf("kernelbench: median of %d repetitions, density %.2f\n", reps, RHO);
+
+  for (k=0; k < (int) (sizeof(shapes)/sizeof(shapes[0])); k++)
+    {
+      lx = shapes[k][0];
+      ly = shapes[k][1];
+
+      printf("\n");
+
+      if (benchupdates(lx, ly, reps)) return 1;
+
+      benchhalo(lx, ly, reps);
+      benchrng(lx, ly, reps);
+      benchpbm(lx, ly, reps);
+    }
+
+  return 0;
+}
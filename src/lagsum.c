@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "lagsum.h"
+
+lagsum *lagcreate(int lag)
+{
+  lagsum *l;
+  int k;
+
+  l = (lagsum *) calloc(1, sizeof(lagsum));
+
+  l->lag = lag;
+
+  // room for lag outstanding sums plus the one just started
+
+  l->step = (long *) malloc((lag+1)*sizeof(long));
+  l->local = (long *) malloc((lag+1)*sizeof(long));
+  l->global = (long *) malloc((lag+1)*sizeof(long));
+  l->request = (MPI_Request *) malloc((lag+1)*sizeof(MPI_Request));
+
+  for (k=0; k <= lag; k++)
+    {
+      l->request[k] = MPI_REQUEST_NULL;
+    }
+
+  return l;
+}
+
+/*
+ *  Start summing local over all processes for step. At most lag sums
+ *  may be outstanding before the next push, so pop first. Collective.
+ */
+
+void lagpush(lagsum *l, long step, long local, MPI_Comm comm)
+{
+  int k = (l->first + l->n) % (l->lag+1);
+
+  l->step[k] = step;
+  l->local[k] = local;
+
+  MPI_Iallreduce(&l->local[k], &l->global[k], 1, MPI_LONG, MPI_SUM, comm,
+                 &l->request[k]);
+
+  l->n++;
+}
+
+/*
+ *  If more than lag sums are outstanding, or any are and wait is set,
+ *  complete the oldest and return 1 with its step and value; return 0
+ *  otherwise. This depends only on the steps pushed, never on timing,
+ *  so every process gets each sum on the same step and they all take
+ *  the same decisions from it.
+ */
+
+int lagpop(lagsum *l, long *step, long *global, int wait)
+{
+  int k;
+
+  if (l->n == 0 || (!wait && l->n <= l->lag)) return 0;
+
+  k = l->first;
+
+  MPI_Wait(&l->request[k], MPI_STATUS_IGNORE);
+
+  *step = l->step[k];
+  *global = l->global[k];
+
+  l->first = (k+1) % (l->lag+1);
+  l->n--;
+
+  return 1;
+}
+
+/*
+ *  Complete any outstanding sums, discarding them
+ */
+
+void lagfree(lagsum *l)
+{
+  MPI_Waitall(l->lag+1, l->request, MPI_STATUSES_IGNORE);
+
+  free(l->step);
+  free(l->local);
+  free(l->global);
+  free(l->request);
+  free(l);
+}
@@ -0,0 +1,96 @@
+#include <limits.h>
+#include <mpi.h>
+
+#include "largecount.h"
+
+/*
+ *  MPI_Bcast of count elements, in chunks
+ */
+
+void largebcast(void *buf, long count, MPI_Datatype type, int root,
+                MPI_Comm comm)
+{
+  MPI_Aint lb, extent;
+  long k, n;
+
+  MPI_Type_get_extent(type, &lb, &extent);
+
+  for (k=0; k < count; k += LARGECHUNK)
+    {
+      n = (count - k < LARGECHUNK) ? count - k : LARGECHUNK;
+
+      MPI_Bcast((char *) buf + k*extent, (int) n, type, root, comm);
+    }
+}
+
+/*
+ *  MPI_Reduce of count elements, in chunks. recvbuf is only used on
+ *  root.
+ */
+
+void largereduce(const void *sendbuf, void *recvbuf, long count,
+                 MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm)
+{
+  MPI_Aint lb, extent;
+  long k, n;
+  int rank;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Type_get_extent(type, &lb, &extent);
+
+  for (k=0; k < count; k += LARGECHUNK)
+    {
+      n = (count - k < LARGECHUNK) ? count - k : LARGECHUNK;
+
+      MPI_Reduce((const char *) sendbuf + k*extent,
+                 (rank == root) ? (char *) recvbuf + k*extent : recvbuf,
+                 (int) n, type, op, root, comm);
+    }
+}
+
+/*
+ *  Return n and set *big so that n elements of *big are count
+ *  elements of type. Above INT_MAX, *big is a committed type made of
+ *  whole LARGECHUNKs followed by the remainder, and n is 1; release
+ *  it with largefree.
+ */
+
+int largetype(long count, MPI_Datatype type, MPI_Datatype *big)
+{
+  MPI_Datatype chunk, part[2];
+  MPI_Aint lb, extent, disp[2];
+  int len[2] = {1, 1};
+  long q, r;
+
+  if (count <= INT_MAX)
+    {
+      *big = type;
+      return (int) count;
+    }
+
+  MPI_Type_get_extent(type, &lb, &extent);
+
+  q = count/LARGECHUNK;
+  r = count%LARGECHUNK;
+
+  MPI_Type_contiguous((int) LARGECHUNK, type, &chunk);
+  MPI_Type_contiguous((int) q, chunk, &part[0]);
+  MPI_Type_contiguous((int) r, type, &part[1]);
+
+  disp[0] = 0;
+  disp[1] = (MPI_Aint) q*LARGECHUNK*extent;
+
+  MPI_Type_create_struct(r > 0 ? 2 : 1, len, disp, part, big);
+  MPI_Type_commit(big);
+
+  MPI_Type_free(&chunk);
+  MPI_Type_free(&part[0]);
+  MPI_Type_free(&part[1]);
+
+  return 1;
+}
+
+void largefree(MPI_Datatype *big, MPI_Datatype type)
+{
+  if (*big != type) MPI_Type_free(big);
+}
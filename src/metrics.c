@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "metrics.h"
+
+static const char *phasename[METRIC_PHASES] = {"halo", "update", "reduce", "output"};
+
+/*
+ *  Open the file the next sample is written to on rank 0: the file
+ *  itself, emptied, with METRICS_JSON or a fresh <file>.tmp with
+ *  METRICS_PROM. Returns 0 if it cannot be opened.
+ */
+
+static int metricsopen(metrics *m)
+{
+  const char *name = (m->format == METRICS_PROM) ? m->tmpname : m->name;
+
+  if (MPI_File_open(MPI_COMM_SELF, name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &m->fh) != MPI_SUCCESS)
+    {
+      return 0;
+    }
+
+  MPI_File_set_size(m->fh, 0);
+
+  return 1;
+}
+
+/*
+ *  METRICS_PROM: once the sample in <file>.tmp is on disk, close it and
+ *  rename it over the file, waiting for the write if wait is set
+ */
+
+static void metricsreplace(metrics *m, int wait)
+{
+  int done;
+
+  if (!m->replace) return;
+
+  MPI_Test(&m->write[0], &done, MPI_STATUS_IGNORE);
+
+  if (!done)
+    {
+      if (!wait) return;
+
+      m->nwait++;
+      MPI_Wait(&m->write[0], MPI_STATUS_IGNORE);
+    }
+
+  MPI_File_close(&m->fh);
+
+  if (rename(m->tmpname, m->name) != 0)
+    {
+      printf("metrics: cannot rename <%s> to <%s>\n", m->tmpname, m->name);
+    }
+
+  m->replace = 0;
+}
+
+/*
+ *  Start the metrics of a run from step0 on. The file is opened on
+ *  rank 0; returns NULL on every process if it cannot be. Collective.
+ */
+
+metrics *metricscreate(const char *name, int format, int freq, long step0,
+                       MPI_Comm comm)
+{
+  metrics *m;
+  int ok, k;
+
+  m = (metrics *) calloc(1, sizeof(metrics));
+
+  MPI_Comm_rank(comm, &m->rank);
+
+  m->comm = comm;
+  m->format = format;
+  m->freq = freq;
+  m->step0 = step0;
+  m->laststep = step0;
+
+  m->name = (char *) malloc(strlen(name)+5);
+  m->tmpname = (char *) malloc(strlen(name)+5);
+
+  strcpy(m->name, name);
+  sprintf(m->tmpname, "%s.tmp", name);
+
+  ok = 1;
+
+  if (m->rank == 0) ok = metricsopen(m);
+
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+
+  if (!ok)
+    {
+      free(m->name);
+      free(m->tmpname);
+      free(m);
+      return NULL;
+    }
+
+  for (k=0; k < METRICBUFFERS; k++)
+    {
+      m->buf[k] = (char *) malloc(METRICLINE);
+      m->write[k] = MPI_REQUEST_NULL;
+    }
+
+  m->request[0] = MPI_REQUEST_NULL;
+  m->request[1] = MPI_REQUEST_NULL;
+
+  m->t0 = MPI_Wtime();
+  m->lasttime = m->t0;
+  m->mark = m->t0;
+
+  return m;
+}
+
+/*
+ *  Charge the time since the previous call to phase
+ */
+
+void metricsphase(metrics *m, int phase)
+{
+  double t = MPI_Wtime();
+
+  m->phase[phase] += t - m->mark;
+  m->mark = t;
+}
+
+/*
+ *  Format a sample over steps laststep ... step and hand it to the
+ *  writer on rank 0: ncell living cells, bytes of halos and the phase
+ *  times of the slowest process over those steps.
+ */
+
+static void metricswrite(metrics *m, long step, double time, long ncell,
+                         long bytes, const double *phase, int final)
+{
+  double dt, rate;
+  char *buf;
+  int k, done, len;
+
+  // METRICS_PROM writes a new <file>.tmp once the previous one has
+  // replaced the file; METRICS_JSON only needs the buffer back
+
+  if (m->format == METRICS_PROM)
+    {
+      metricsreplace(m, 1);
+
+      if (m->fh == MPI_FILE_NULL && !metricsopen(m)) return;
+
+      m->next = 0;
+    }
+
+  k = m->next;
+
+  MPI_Test(&m->write[k], &done, MPI_STATUS_IGNORE);
+
+  if (!done)
+    {
+      m->nwait++;
+      MPI_Wait(&m->write[k], MPI_STATUS_IGNORE);
+    }
+
+  buf = m->buf[k];
+
+  dt = time - m->lasttime;
+  rate = (dt > 0.0) ? (step - m->laststep)/dt : 0.0;
+
+  if (m->format == METRICS_JSON)
+    {
+      len = snprintf(buf, METRICLINE,
+                     "{\"step\":%ld,\"time\":%.6f,\"ncell\":%ld,\"steps_per_s\":%.6g,"
+                     "\"cells_per_s\":%.6g,\"halo_bytes_per_s\":%.6g,\"phase_s\":{",
+                     step, time - m->t0, ncell, rate, rate*L*L,
+                     (dt > 0.0) ? bytes/dt : 0.0);
+
+      for (k=0; k < METRIC_PHASES; k++)
+        {
+          len += snprintf(buf+len, METRICLINE-len, "%s\"%s\":%.6g",
+                          k > 0 ? "," : "", phasename[k], phase[k]);
+        }
+
+      if (final)
+        {
+          len += snprintf(buf+len, METRICLINE-len,
+                          "},\"final\":true,\"ms_per_step\":%.6f}\n",
+                          (step > m->laststep) ? 1000*dt/(step - m->laststep) : 0.0);
+        }
+      else
+        {
+          len += snprintf(buf+len, METRICLINE-len, "}}\n");
+        }
+
+      MPI_File_iwrite_at(m->fh, m->end, buf, len, MPI_CHAR, &m->write[m->next]);
+      m->end += len;
+    }
+  else
+    {
+      len = snprintf(buf, METRICLINE,
+                     "# TYPE automaton_step gauge\n"
+                     "automaton_step %20ld\n"
+                     "# TYPE automaton_time_seconds gauge\n"
+                     "automaton_time_seconds %20.9e\n"
+                     "# TYPE automaton_living_cells gauge\n"
+                     "automaton_living_cells %20ld\n"
+                     "# TYPE automaton_steps_per_second gauge\n"
+                     "automaton_steps_per_second %20.9e\n"
+                     "# TYPE automaton_cells_per_second gauge\n"
+                     "automaton_cells_per_second %20.9e\n"
+                     "# TYPE automaton_halo_bytes_per_second gauge\n"
+                     "automaton_halo_bytes_per_second %20.9e\n"
+                     "# TYPE automaton_phase_seconds gauge\n",
+                     step, time - m->t0, ncell, rate, rate*L*L,
+                     (dt > 0.0) ? bytes/dt : 0.0);
+
+      for (k=0; k < METRIC_PHASES; k++)
+        {
+          len += snprintf(buf+len, METRICLINE-len,
+                          "automaton_phase_seconds{phase=\"%s\"}%*s %20.9e\n",
+                          phasename[k], (int) (6 - strlen(phasename[k])), "",
+                          phase[k]);
+        }
+
+      len += snprintf(buf+len, METRICLINE-len,
+                      "# TYPE automaton_final gauge\n"
+                      "automaton_final %d\n", final);
+
+      MPI_File_iwrite_at(m->fh, 0, buf, len, MPI_CHAR, &m->write[m->next]);
+      m->replace = 1;
+    }
+
+  m->next = (m->next+1) % METRICBUFFERS;
+  m->laststep = step;
+  m->lasttime = time;
+}
+
+/*
+ *  Write the sample being reduced if it has arrived
+ */
+
+static void metricspoll(metrics *m, int wait)
+{
+  int done;
+
+  if (!m->pending) return;
+
+  MPI_Testall(2, m->request, &done, MPI_STATUSES_IGNORE);
+
+  if (!done)
+    {
+      if (!wait) return;
+
+      m->nwait++;
+      MPI_Waitall(2, m->request, MPI_STATUSES_IGNORE);
+    }
+
+  m->pending = 0;
+
+  if (m->rank == 0)
+    {
+      metricswrite(m, m->step, m->time, m->allsum[0], m->allsum[1],
+                   m->allmax, 0);
+    }
+}
+
+/*
+ *  Called every step after the update: write any sample that has
+ *  arrived and, every freq steps, start reducing a new one from the
+ *  local living cells. Collective.
+ */
+
+void metricsstep(metrics *m, grid *g, long step, long localncell)
+{
+  long bytes;
+  int k;
+
+  metricspoll(m, 0);
+
+  if (m->rank == 0) metricsreplace(m, 0);
+
+  if (step % m->freq != 0) return;
+
+  // only one sample is reduced at a time
+
+  metricspoll(m, 1);
+
+  bytes = g->halobytes[0] + g->halobytes[1] + g->halobytes[2] + g->halobytes[3];
+
+  m->sum[0] = localncell;
+  m->sum[1] = bytes - m->lastbytes;
+  m->lastbytes = bytes;
+
+  for (k=0; k < METRIC_PHASES; k++)
+    {
+      m->max[k] = m->phase[k];
+      m->total[k] += m->phase[k];
+      m->phase[k] = 0.0;
+    }
+
+  m->step = step;
+  m->time = MPI_Wtime();
+  m->pending = 1;
+
+  MPI_Ireduce(m->sum, m->allsum, 2, MPI_LONG, MPI_SUM, 0, m->comm,
+              &m->request[0]);
+  MPI_Ireduce(m->max, m->allmax, METRIC_PHASES, MPI_DOUBLE, MPI_MAX, 0,
+              m->comm, &m->request[1]);
+}
+
+/*
+ *  Write the last sample, with the rates and phase times over the
+ *  whole run, wait for the writes and close the file. Collective.
+ */
+
+void metricsfree(metrics *m, grid *g, long step, long localncell)
+{
+  long sum[2], allsum[2];
+  double allmax[METRIC_PHASES];
+  int k;
+
+  metricspoll(m, 1);
+
+  sum[0] = localncell;
+  sum[1] = g->halobytes[0] + g->halobytes[1] + g->halobytes[2] + g->halobytes[3];
+
+  for (k=0; k < METRIC_PHASES; k++)
+    {
+      m->total[k] += m->phase[k];
+    }
+
+  MPI_Reduce(sum, allsum, 2, MPI_LONG, MPI_SUM, 0, m->comm);
+  MPI_Reduce(m->total, allmax, METRIC_PHASES, MPI_DOUBLE, MPI_MAX, 0, m->comm);
+
+  if (m->rank == 0)
+    {
+      m->laststep = m->step0;
+      m->lasttime = m->t0;
+
+      metricswrite(m, step, MPI_Wtime(), allsum[0], allsum[1], allmax, 1);
+
+      if (m->format == METRICS_PROM)
+        {
+          metricsreplace(m, 1);
+        }
+      else
+        {
+          MPI_Waitall(METRICBUFFERS, m->write, MPI_STATUSES_IGNORE);
+          MPI_File_close(&m->fh);
+        }
+    }
+
+  for (k=0; k < METRICBUFFERS; k++)
+    {
+      free(m->buf[k]);
+    }
+
+  free(m->name);
+  free(m->tmpname);
+
+  free(m);
+}
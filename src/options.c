@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+#include "options.h"
+#include "snapshot.h"
+#include "view.h"
+#include "rng.h"
+#include "topology.h"
+#include "metrics.h"
+
+/*
+ *  Option types
+ */
+
+#define OPT_INT    0
+#define OPT_DOUBLE 1
+#define OPT_STRING 2
+#define OPT_CHOICE 3 // keyword stored as its index in "choices"
+
+typedef struct
+{
+  const char *name;
+  int type;
+  void *var;
+  const char **choices;
+  const char *help;
+} autooption;
+
+static const char *layouts[] = {"rowmajor", "tiled", "mapped", NULL};
+static const char *engines[] = {"dense", "sparse", NULL};
+static const char *halos[] = {"vector", "manual", "pack", "auto", NULL};
+static const char *snapformats[] = {"raw", "rle", NULL};
+static const char *images[] = {"full", "window", "coarse", NULL};
+static const char *rngs[] = {"uni", "counter", NULL};
+static const char *procgrids[] = {"dims", "plan", NULL};
+static const char *metricsformats[] = {"json", "prom", NULL};
+
+/*
+ *  Table of all options. The defaults are set in getoptions.
+ */
+
+static int opttable(autooptions *opt, autooption *table)
+{
+  autooption t[] =
+    {
+      {"-rng", OPT_CHOICE, &opt->rng, rngs,
+       "initial cells from the original uni or a counter-based generator"},
+      {"-tile", OPT_INT, &opt->tile, NULL,
+       "weak scaling: L = N times the side of the process grid, N x N cells each (0 off)"},
+      {"-layout", OPT_CHOICE, &opt->layout, layouts,
+       "storage of the local grid: rowmajor, tiled or mapped (out of core)"},
+      {"-mapdir", OPT_STRING, &opt->mapdir, NULL,
+       "directory of the files of -layout mapped"},
+      {"-engine", OPT_CHOICE, &opt->engine, engines,
+       "update every block in full, or sparse blocks from lists of living cells"},
+      {"-halo", OPT_CHOICE, &opt->halo, halos,
+       "column halos: vector, manual, pack or auto"},
+      {"-async", OPT_INT, &opt->async, NULL,
+       "overlap halos with tiles, global count up to N steps late (0 off)"},
+      {"-ahead", OPT_INT, &opt->ahead, NULL,
+       "with -async, blocks may run up to N steps ahead of the slowest (0 off)"},
+      {"-balance", OPT_INT, &opt->balance, NULL,
+       "move the tile boundaries to even out update times every N steps (0 off)"},
+      {"-procgrid", OPT_CHOICE, &opt->procgrid, procgrids,
+       "process grid from MPI_Dims_create or planned for the nodes"},
+      {"-nodesize", OPT_INT, &opt->nodesize, NULL,
+       "ranks per node for -procgrid plan (0 detects the nodes)"},
+      {"-cycle", OPT_INT, &opt->cycle, NULL,
+       "stop on a fixed point or cycle, checked every N steps (0 off)"},
+      {"-cycleperiod", OPT_INT, &opt->cycleperiod, NULL,
+       "longest cycle period detected"},
+      {"-verify", OPT_INT, &opt->verify, NULL,
+       "write the grid checksum every N steps (0 off)"},
+      {"-trace", OPT_STRING, &opt->trace, NULL,
+       "checksum trace file"},
+      {"-golden", OPT_STRING, &opt->golden, NULL,
+       "compare the checksums with this trace"},
+      {"-checkpoint", OPT_INT, &opt->checkpoint, NULL,
+       "write a checkpoint every N steps (0 off)"},
+      {"-ckptfile", OPT_STRING, &opt->ckptfile, NULL,
+       "checkpoint files are <name>.0 and <name>.1"},
+      {"-restart", OPT_STRING, &opt->restart, NULL,
+       "start from this checkpoint file"},
+      {"-input", OPT_STRING, &opt->input, NULL,
+       "start from this P1/P4 PBM or raw L x L byte file"},
+      {"-snapshot", OPT_INT, &opt->snapshot, NULL,
+       "stream a frame of the grid every N steps (0 off)"},
+      {"-snapfile", OPT_STRING, &opt->snapfile, NULL,
+       "snapshot time series file"},
+      {"-snapformat", OPT_CHOICE, &opt->snapformat, snapformats,
+       "frames stored raw or compressed tile by tile (rle)"},
+      {"-image", OPT_CHOICE, &opt->image, images,
+       "final image: full (cell.pbm), window (cell.pbm) or coarse (cell.pgm)"},
+      {"-window", OPT_STRING, &opt->window, NULL,
+       "window x,y,nx,ny written by -image window"},
+      {"-coarse", OPT_INT, &opt->coarse, NULL,
+       "block size of the density in -image coarse"},
+      {"-cluster", OPT_INT, &opt->cluster, NULL,
+       "count the clusters every N steps (0 off)"},
+      {"-stats", OPT_INT, &opt->stats, NULL,
+       "record density and flips every step, written every N steps (0 off)"},
+      {"-statsfile", OPT_STRING, &opt->statsfile, NULL,
+       "statistics time series, the flip heatmap goes to <name>.heat"},
+      {"-sweep", OPT_INT, &opt->sweep, NULL,
+       "bisect rho N times towards where the run starts to terminate (0 off)"},
+      {"-rholo", OPT_DOUBLE, &opt->rholo, NULL,
+       "lowest rho of -sweep"},
+      {"-rhohi", OPT_DOUBLE, &opt->rhohi, NULL,
+       "highest rho of -sweep"},
+      {"-metrics", OPT_INT, &opt->metrics, NULL,
+       "write run metrics every N steps instead of progress lines (0 off)"},
+      {"-metricsfile", OPT_STRING, &opt->metricsfile, NULL,
+       "metrics file"},
+      {"-metricsformat", OPT_CHOICE, &opt->metricsformat, metricsformats,
+       "metrics appended as JSON lines (json) or rewritten for Prometheus (prom)"},
+    };
+
+  int n = sizeof(t)/sizeof(t[0]);
+
+  if (table != NULL) memcpy(table, t, sizeof(t));
+
+  return n;
+}
+
+static int setoption(autooption *o, const char *val)
+{
+  char *end;
+  int k;
+
+  switch (o->type)
+    {
+    case OPT_INT:
+      *(int *) o->var = (int) strtol(val, &end, 10);
+      return (*end != '\0');
+
+    case OPT_DOUBLE:
+      *(double *) o->var = strtod(val, &end);
+      return (*end != '\0');
+
+    case OPT_STRING:
+      *(const char **) o->var = val;
+      return 0;
+
+    case OPT_CHOICE:
+      for (k=0; o->choices[k] != NULL; k++)
+        {
+          if (strcmp(val, o->choices[k]) == 0)
+            {
+              *(int *) o->var = k;
+              return 0;
+            }
+        }
+      return 1;
+    }
+
+  return 1;
+}
+
+/*
+ *  Parse the options following the seed. Returns 0 on success and 1
+ *  if the command line is invalid.
+ */
+
+int getoptions(int argc, char *argv[], autooptions *opt)
+{
+  autooption table[64];
+  int a, k, n;
+
+  opt->rng = RNG_UNI;
+  opt->tile = 0;
+  opt->layout = GRID_ROWMAJOR;
+  opt->mapdir = ".";
+  opt->engine = GRID_DENSE;
+  opt->halo = HALO_AUTO;
+  opt->async = 0;
+  opt->ahead = 0;
+  opt->balance = 0;
+  opt->procgrid = TOPO_DIMS;
+  opt->nodesize = 0;
+  opt->cycle = 0;
+  opt->cycleperiod = 64;
+  opt->verify = 0;
+  opt->trace = "checksum.trace";
+  opt->golden = NULL;
+  opt->checkpoint = 0;
+  opt->ckptfile = "automaton.ckpt";
+  opt->restart = NULL;
+  opt->input = NULL;
+  opt->snapshot = 0;
+  opt->snapfile = "automaton.snap";
+  opt->snapformat = SNAP_RAW;
+  opt->cluster = 0;
+  opt->image = IMAGE_FULL;
+  opt->window = "0,0,64,64";
+  opt->coarse = 8;
+  opt->stats = 0;
+  opt->statsfile = "automaton.stats";
+  opt->sweep = 0;
+  opt->rholo = 0.3;
+  opt->rhohi = 0.52;
+  opt->metrics = 0;
+  opt->metricsfile = "automaton.metrics";
+  opt->metricsformat = METRICS_JSON;
+
+  n = opttable(opt, table);
+
+  for (a=2; a < argc; a += 2)
+    {
+      for (k=0; k < n; k++)
+        {
+          if (strcmp(argv[a], table[k].name) == 0) break;
+        }
+
+      if (k == n || a+1 >= argc || setoption(&table[k], argv[a+1]) != 0)
+        {
+          return 1;
+        }
+    }
+
+  return 0;
+}
+
+void printusage(void)
+{
+  autooption table[64];
+  autooptions dummy;
+  int k, n;
+
+  n = opttable(&dummy, table);
+
+  printf("Usage: automaton <seed> [options]\n");
+
+  for (k=0; k < n; k++)
+    {
+      printf("  %-14s %s\n", table[k].name, table[k].help);
+    }
+}
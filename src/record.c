@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "record.h"
+
+/*
+ *  Committed type of one record of nf fields whose extent is that of
+ *  the struct, so that count > 1 steps through an array of them
+ */
+
+MPI_Datatype recordtype(const recordfield *f, int nf, MPI_Aint extent)
+{
+  MPI_Datatype tmp, rec;
+  MPI_Datatype *type;
+  MPI_Aint *disp;
+  int *len;
+  int k;
+
+  if (nf < 1) return MPI_DATATYPE_NULL;
+
+  type = (MPI_Datatype *) malloc(nf*sizeof(MPI_Datatype));
+  disp = (MPI_Aint *) malloc(nf*sizeof(MPI_Aint));
+  len = (int *) malloc(nf*sizeof(int));
+
+  for (k=0; k < nf; k++)
+    {
+      type[k] = f[k].type;
+      disp[k] = f[k].offset;
+      len[k] = f[k].count;
+    }
+
+  MPI_Type_create_struct(nf, len, disp, type, &tmp);
+  MPI_Type_create_resized(tmp, 0, extent, &rec);
+  MPI_Type_commit(&rec);
+  MPI_Type_free(&tmp);
+
+  free(type);
+  free(disp);
+  free(len);
+
+  return rec;
+}
+
+/*
+ *  Committed type of n records of an array of structs, field by
+ *  field: field k is a vector of n blocks of f[k].count elements, one
+ *  struct apart. Used with the address of the array.
+ */
+
+MPI_Datatype recordaos(const recordfield *f, int nf, MPI_Aint extent, int n)
+{
+  MPI_Datatype aos;
+  MPI_Datatype *type;
+  MPI_Aint *disp;
+  int *len;
+  int k;
+
+  if (nf < 1) return MPI_DATATYPE_NULL;
+
+  type = (MPI_Datatype *) malloc(nf*sizeof(MPI_Datatype));
+  disp = (MPI_Aint *) malloc(nf*sizeof(MPI_Aint));
+  len = (int *) malloc(nf*sizeof(int));
+
+  for (k=0; k < nf; k++)
+    {
+      MPI_Type_create_hvector(n, f[k].count, extent, f[k].type, &type[k]);
+      disp[k] = f[k].offset;
+      len[k] = 1;
+    }
+
+  MPI_Type_create_struct(nf, len, disp, type, &aos);
+  MPI_Type_commit(&aos);
+
+  for (k=0; k < nf; k++)
+    {
+      MPI_Type_free(&type[k]);
+    }
+
+  free(type);
+  free(disp);
+  free(len);
+
+  return aos;
+}
+
+/*
+ *  Committed type of n records held as nf separate arrays, arrays[k]
+ *  holding the n*f[k].count elements of field k. The displacements are
+ *  absolute addresses, so the buffer is MPI_BOTTOM.
+ */
+
+MPI_Datatype recordsoa(const recordfield *f, int nf, void **arrays, int n)
+{
+  MPI_Datatype soa;
+  MPI_Datatype *type;
+  MPI_Aint *disp;
+  int *len;
+  int k;
+
+  if (nf < 1) return MPI_DATATYPE_NULL;
+
+  type = (MPI_Datatype *) malloc(nf*sizeof(MPI_Datatype));
+  disp = (MPI_Aint *) malloc(nf*sizeof(MPI_Aint));
+  len = (int *) malloc(nf*sizeof(int));
+
+  for (k=0; k < nf; k++)
+    {
+      type[k] = f[k].type;
+      MPI_Get_address(arrays[k], &disp[k]);
+      len[k] = n*f[k].count;
+    }
+
+  MPI_Type_create_struct(nf, len, disp, type, &soa);
+  MPI_Type_commit(&soa);
+
+  free(type);
+  free(disp);
+  free(len);
+
+  return soa;
+}
+
+/*
+ *  Copy n items of size bytes from stride sstride to stride dstride.
+ *  The common sizes are copied as one word each.
+ */
+
+static void copyitems(char *dst, MPI_Aint dstride, const char *src,
+                      MPI_Aint sstride, int size, int n)
+{
+  int r;
+
+  switch (size)
+    {
+    case 4:
+      for (r=0; r < n; r++)
+        {
+          memcpy(dst + r*dstride, src + r*sstride, 4);
+        }
+      break;
+
+    case 8:
+      for (r=0; r < n; r++)
+        {
+          memcpy(dst + r*dstride, src + r*sstride, 8);
+        }
+      break;
+
+    default:
+      for (r=0; r < n; r++)
+        {
+          memcpy(dst + r*dstride, src + r*sstride, size);
+        }
+      break;
+    }
+}
+
+/*
+ *  Copy n records from an array of structs to one array per field,
+ *  or back, by hand
+ */
+
+void recordpack(const recordfield *f, int nf, MPI_Aint extent, const void *aos,
+                int n, void **arrays)
+{
+  int k, size;
+
+  for (k=0; k < nf; k++)
+    {
+      MPI_Type_size(f[k].type, &size);
+      size *= f[k].count;
+
+      copyitems((char *) arrays[k], size, (const char *) aos + f[k].offset,
+                extent, size, n);
+    }
+}
+
+void recordunpack(const recordfield *f, int nf, MPI_Aint extent, void *aos,
+                  int n, void **arrays)
+{
+  int k, size;
+
+  for (k=0; k < nf; k++)
+    {
+      MPI_Type_size(f[k].type, &size);
+      size *= f[k].count;
+
+      copyitems((char *) aos + f[k].offset, extent, (const char *) arrays[k],
+                size, size, n);
+    }
+}
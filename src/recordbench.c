@@ -0,0 +1,309 @@
+/*
+ *  Benchmark of moving n records from an array of structs on rank 0
+ *  to one array per field on rank 1 (make recordbench).
+ *
+ *  mpirun -n 2 ./recordbench [reps]
+ *
+ *  For n = 10 ... 10^7 records of {double, int, double} each way of
+ *  sending them is timed reps times (default 11), each transfer
+ *  followed by an empty acknowledgement:
+ *
+ *    each     one record type on the send side and a receive type with
+ *             a single-element block per field per record (up to
+ *             EACHMAX records)
+ *    strided  recordaos to recordsoa, one block per field
+ *    pack     recordpack into one array per field, which are then sent
+ *             as they are
+ *    soa      the arrays per field are sent as they are, as if the
+ *             records were kept that way on both sides
+ *
+ *  The median time is reported in us and GB/s of field data (20 bytes
+ *  a record, without the padding), with the time to build the types.
+ *  The records received are checked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "record.h"
+
+#define NMAX    10000000 // largest number of records
+#define EACHMAX 100000   // largest number sent with per-record blocks
+#define ACKTAG  100
+
+typedef struct
+{
+  double d1;
+  int i;
+  double d2;
+} payload;
+
+static const recordfield fields[] =
+  {
+    RECORDFIELD(payload, d1, MPI_DOUBLE, 1),
+    RECORDFIELD(payload, i, MPI_INT, 1),
+    RECORDFIELD(payload, d2, MPI_DOUBLE, 1)
+  };
+
+#define NFIELD 3
+
+#define SEND_EACH    0
+#define SEND_STRIDED 1
+#define SEND_PACK    2
+#define SEND_SOA     3
+#define SENDS        4
+
+static const char *name[SENDS] = {"each", "strided", "pack", "soa"};
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ *  Receive type of the original exercise: one block per field per
+ *  record, at the position of the value in its array
+ */
+
+static MPI_Datatype eachtype(void **arrays, int n)
+{
+  MPI_Datatype each;
+  MPI_Datatype *type;
+  MPI_Aint *disp;
+  int *len;
+  int r, k, size;
+
+  type = (MPI_Datatype *) malloc((size_t) NFIELD*n*sizeof(MPI_Datatype));
+  disp = (MPI_Aint *) malloc((size_t) NFIELD*n*sizeof(MPI_Aint));
+  len = (int *) malloc((size_t) NFIELD*n*sizeof(int));
+
+  for (r=0; r < n; r++)
+    {
+      for (k=0; k < NFIELD; k++)
+        {
+          MPI_Type_size(fields[k].type, &size);
+          MPI_Get_address((char *) arrays[k] + (size_t) r*size,
+                          &disp[r*NFIELD+k]);
+          type[r*NFIELD+k] = fields[k].type;
+          len[r*NFIELD+k] = 1;
+        }
+    }
+
+  MPI_Type_create_struct(NFIELD*n, len, disp, type, &each);
+  MPI_Type_commit(&each);
+
+  free(type);
+  free(disp);
+  free(len);
+
+  return each;
+}
+
+/*
+ *  Send n records from rank 0 to rank 1 by method m, timing the types
+ *  built on rank 1 in *build. Collective over the two ranks.
+ */
+
+static void transfer(int m, int n, int rank, payload *aos, void **send,
+                     void **recv, double *build)
+{
+  MPI_Datatype rec, type;
+  double t;
+  int k;
+
+  t = MPI_Wtime();
+
+  if (rank == 0)
+    {
+      switch (m)
+        {
+        case SEND_EACH:
+          rec = recordtype(fields, NFIELD, sizeof(payload));
+          MPI_Send(aos, n, rec, 1, 0, MPI_COMM_WORLD);
+          MPI_Type_free(&rec);
+          break;
+
+        case SEND_STRIDED:
+          type = recordaos(fields, NFIELD, sizeof(payload), n);
+          MPI_Send(aos, 1, type, 1, 0, MPI_COMM_WORLD);
+          MPI_Type_free(&type);
+          break;
+
+        case SEND_PACK:
+          recordpack(fields, NFIELD, sizeof(payload), aos, n, send);
+          // fall through: the arrays go as they are
+
+        default:
+          for (k=0; k < NFIELD; k++)
+            {
+              MPI_Send(send[k], n, fields[k].type, 1, k, MPI_COMM_WORLD);
+            }
+          break;
+        }
+    }
+  else
+    {
+      switch (m)
+        {
+        case SEND_EACH:
+          type = eachtype(recv, n);
+          *build = MPI_Wtime() - t;
+          MPI_Recv(MPI_BOTTOM, 1, type, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          MPI_Type_free(&type);
+          break;
+
+        case SEND_STRIDED:
+          type = recordsoa(fields, NFIELD, recv, n);
+          *build = MPI_Wtime() - t;
+          MPI_Recv(MPI_BOTTOM, 1, type, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          MPI_Type_free(&type);
+          break;
+
+        default:
+          *build = 0.0;
+          for (k=0; k < NFIELD; k++)
+            {
+              MPI_Recv(recv[k], n, fields[k].type, 0, k, MPI_COMM_WORLD,
+                       MPI_STATUS_IGNORE);
+            }
+          break;
+        }
+    }
+}
+
+/*
+ *  Number of records on rank 1 that differ from those on rank 0
+ */
+
+static int check(int n, void **recv)
+{
+  const double *d1 = (const double *) recv[0];
+  const int *i = (const int *) recv[1];
+  const double *d2 = (const double *) recv[2];
+  int r, nbad = 0;
+
+  for (r=0; r < n; r++)
+    {
+      nbad += (d1[r] != 4.0*r || i[r] != 15*r || d2[r] != 2.0*r + 100.0);
+    }
+
+  return nbad;
+}
+
+int main(int argc, char *argv[])
+{
+  payload *aos;
+  void *send[NFIELD], *recv[NFIELD];
+  double *t, build, t0;
+  int rank, size, reps, n, m, k, r, nbad, fsize;
+
+  MPI_Init(&argc, &argv);
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  reps = (argc > 1) ? atoi(argv[1]) : 11;
+
+  if (size != 2 || argc > 2 || reps < 1)
+    {
+      if (rank == 0) printf("Usage: mpirun -n 2 recordbench [reps]\n");
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  aos = (payload *) malloc((size_t) NMAX*sizeof(payload));
+  t = (double *) malloc(reps*sizeof(double));
+
+  for (k=0; k < NFIELD; k++)
+    {
+      send[k] = malloc((size_t) NMAX*sizeof(double));
+      recv[k] = malloc((size_t) NMAX*sizeof(double));
+    }
+
+  for (r=0; r < NMAX; r++)
+    {
+      aos[r].d1 = 4.0*r;
+      aos[r].i = 15*r;
+      aos[r].d2 = 2.0*r + 100.0;
+    }
+
+  // the soa method sends arrays that already hold the records
+
+  recordpack(fields, NFIELD, sizeof(payload), aos, NMAX, send);
+
+  if (rank == 0)
+    {
+      printf("recordbench: median of %d repetitions, %d-byte records, %d bytes of fields\n",
+             reps, (int) sizeof(payload), 20);
+    }
+
+  for (n=10; n <= NMAX; n *= 10)
+    {
+      if (rank == 0) printf("\n");
+
+      for (m=0; m < SENDS; m++)
+        {
+          if (m == SEND_EACH && n > EACHMAX) continue;
+
+          for (k=0; k < reps; k++)
+            {
+              // all ones is NaN in a double and -1 in an int, so a
+              // field that is not received fails the check
+
+              if (rank == 1)
+                {
+                  for (r=0; r < NFIELD; r++)
+                    {
+                      MPI_Type_size(fields[r].type, &fsize);
+                      memset(recv[r], 0xff, (size_t) n*fsize);
+                    }
+                }
+
+              MPI_Barrier(MPI_COMM_WORLD);
+              t0 = MPI_Wtime();
+
+              transfer(m, n, rank, aos, send, recv, &build);
+
+              if (rank == 0)
+                MPI_Recv(NULL, 0, MPI_BYTE, 1, ACKTAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+              else
+                MPI_Send(NULL, 0, MPI_BYTE, 0, ACKTAG, MPI_COMM_WORLD);
+
+              t[k] = MPI_Wtime() - t0;
+            }
+
+          nbad = (rank == 1) ? check(n, recv) : 0;
+
+          MPI_Bcast(&nbad, 1, MPI_INT, 1, MPI_COMM_WORLD);
+          MPI_Bcast(&build, 1, MPI_DOUBLE, 1, MPI_COMM_WORLD);
+
+          if (rank == 0)
+            {
+              qsort(t, reps, sizeof(double), compare);
+
+              printf("%-8s %9d records %12.2f us %8.3f GB/s   build %10.2f us%s\n",
+                     name[m], n, 1.0e6*t[reps/2], 1.0e-9*20.0*n/t[reps/2],
+                     1.0e6*build, nbad ? "   WRONG" : "");
+            }
+        }
+    }
+
+  free(aos);
+  free(t);
+
+  for (k=0; k < NFIELD; k++)
+    {
+      free(send[k]);
+      free(recv[k]);
+    }
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <string.h>
+
+#include "rle.h"
+
+static long packbits(const unsigned char *cell, long n, unsigned char *out)
+{
+  long k;
+
+  out[0] = RLE_BITS;
+  memset(out+1, 0, (n+7)/8);
+
+  for (k=0; k < n; k++)
+    {
+      out[1 + k/8] |= (unsigned char) (cell[k] << (7 - k%8));
+    }
+
+  return 1 + (n+7)/8;
+}
+
+/*
+ *  Encode n cells into out, which must hold RLEBOUND(n) bytes, and
+ *  return the number of bytes used
+ */
+
+long rleencode(const unsigned char *cell, long n, unsigned char *out)
+{
+  long k, run, pos, limit;
+  unsigned char val;
+
+  limit = 1 + (n+7)/8;
+
+  out[0] = RLE_RUNS;
+  pos = 1;
+  val = 0;
+  k = 0;
+
+  while (k < n)
+    {
+      run = 0;
+      while (k < n && cell[k] == val)
+        {
+          run++;
+          k++;
+        }
+
+      while (run >= 128)
+        {
+          out[pos++] = (unsigned char) (0x80 | (run & 0x7f));
+          run >>= 7;
+        }
+      out[pos++] = (unsigned char) run;
+
+      // give up as soon as the runs are no better than the bits
+
+      if (pos >= limit) return packbits(cell, n, out);
+
+      val = 1 - val;
+    }
+
+  return pos;
+}
+
+/*
+ *  Decode size bytes into n cells. Returns 0 on success and 1 if the
+ *  data do not hold exactly n cells.
+ */
+
+int rledecode(const unsigned char *in, long size, unsigned char *cell, long n)
+{
+  long k, run, pos;
+  unsigned char val;
+  int shift;
+
+  if (size < 1) return 1;
+
+  if (in[0] == RLE_BITS)
+    {
+      if (size != 1 + (n+7)/8) return 1;
+
+      for (k=0; k < n; k++)
+        {
+          cell[k] = (in[1 + k/8] >> (7 - k%8)) & 1;
+        }
+
+      return 0;
+    }
+
+  if (in[0] != RLE_RUNS) return 1;
+
+  pos = 1;
+  val = 0;
+  k = 0;
+
+  while (pos < size)
+    {
+      run = 0;
+      shift = 0;
+
+      do
+        {
+          if (pos >= size || shift > 56) return 1;
+          run |= (long) (in[pos] & 0x7f) << shift;
+          shift += 7;
+        }
+      while (in[pos++] & 0x80);
+
+      if (run > n - k) return 1;
+
+      memset(cell+k, val, run);
+      k += run;
+      val = 1 - val;
+    }
+
+  return (k != n);
+}
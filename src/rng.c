@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include "automaton.h"
+#include "rng.h"
+
+#define RNGGAMMA 0x9e3779b97f4a7c15ULL // SplitMix64 increment
+
+static inline uint64_t rngmix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+/*
+ *  Start stream 0 of the generator at position 0. In RNG_UNI mode this
+ *  (re)initialises the global UNI state, as rinit does.
+ */
+
+void rngseed(rng *r, int mode, int seed)
+{
+  r->mode = mode;
+  r->key = rngmix((uint64_t) seed * RNGGAMMA);
+  r->stream = 0;
+  r->counter = 0;
+
+  if (mode == RNG_UNI) rinit(seed);
+}
+
+/*
+ *  Stream s of the same generator, at position 0
+ */
+
+rng rngsubstream(const rng *r, uint64_t s)
+{
+  rng sub = *r;
+
+  sub.stream = rngmix((s + 1) * RNGGAMMA);
+  sub.counter = 0;
+
+  return sub;
+}
+
+/*
+ *  Skip the next n numbers
+ */
+
+void rngjump(rng *r, uint64_t n)
+{
+  uint64_t k;
+
+  if (r->mode == RNG_UNI)
+    {
+      for (k=0; k < n; k++) uni();
+    }
+
+  r->counter += n;
+}
+
+/*
+ *  Fill buf with the next n uniform numbers in [0, 1)
+ */
+
+void rngfill(rng *r, float *buf, long n)
+{
+  const uint64_t key = r->key;
+  const uint64_t stream = r->stream;
+  const uint64_t c0 = r->counter;
+  uint64_t z;
+  long k;
+
+  if (r->mode == RNG_UNI)
+    {
+      for (k=0; k < n; k++) buf[k] = uni();
+    }
+  else
+    {
+      for (k=0; k < n; k++)
+        {
+          z = rngmix((c0 + k)*RNGGAMMA + key);
+          z = rngmix(z ^ stream);
+
+          // top 24 bits, so that the float is exact and below 1
+
+          buf[k] = (float) (z >> 40) * (1.0f/16777216.0f);
+        }
+    }
+
+  r->counter += n;
+}
@@ -0,0 +1,166 @@
+/*
+ *  Decode a snapshot time series written with -snapshot.
+ *
+ *  snapdecode <file>                  list the frames
+ *  snapdecode <file> <frame> <pbm>    write one frame as a PBM file
+ *
+ *  Frames are read on demand: a compressed frame is located through the
+ *  index, so only its own tiles are read from the file.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "automaton.h"
+#include "arraymalloc.h"
+#include "rle.h"
+#include "snapshot.h"
+
+static int readat(FILE *fp, long long offset, void *buf, size_t size)
+{
+  if (fseeko(fp, (off_t) offset, SEEK_SET) != 0) return 1;
+  return (fread(buf, 1, size, fp) != size);
+}
+
+/*
+ *  Read frame k into cell, which is l x l. Returns the number of bytes
+ *  the frame takes in the file, or -1 on error.
+ */
+
+static long long readframe(FILE *fp, snapheader *h, long k, int **cell)
+{
+  snaptile *tiles;
+  snapentry *entries;
+  unsigned char *data, *tile;
+  long long bytes;
+  size_t n;
+  int t, i, j, l, err;
+
+  l = h->l;
+  err = 0;
+
+  if (h->format == SNAP_RAW)
+    {
+      data = (unsigned char *) malloc((size_t) l*l);
+      err = readat(fp, SNAPHEADER + (long long) k*l*l, data, (size_t) l*l);
+
+      for (i=0; i < l && !err; i++)
+        {
+          for (j=0; j < l; j++)
+            {
+              cell[i][j] = data[(size_t) i*l + j];
+            }
+        }
+
+      free(data);
+
+      return err ? -1 : (long long) l*l;
+    }
+
+  tiles = (snaptile *) malloc(h->ntiles*sizeof(snaptile));
+  entries = (snapentry *) malloc(h->ntiles*sizeof(snapentry));
+
+  err |= readat(fp, SNAPHEADER, tiles, h->ntiles*sizeof(snaptile));
+  err |= readat(fp, h->index + (long long) k*h->ntiles*sizeof(snapentry),
+                entries, h->ntiles*sizeof(snapentry));
+
+  bytes = 0;
+
+  for (t=0; t < h->ntiles && !err; t++)
+    {
+      n = (size_t) tiles[t].lx*tiles[t].ly;
+
+      data = (unsigned char *) malloc(entries[t].size);
+      tile = (unsigned char *) malloc(n);
+
+      err |= readat(fp, entries[t].offset, data, entries[t].size);
+      err |= rledecode(data, entries[t].size, tile, n);
+
+      for (i=0; i < tiles[t].lx && !err; i++)
+        {
+          for (j=0; j < tiles[t].ly; j++)
+            {
+              cell[tiles[t].x0+i][tiles[t].y0+j] = tile[(size_t) i*tiles[t].ly + j];
+            }
+        }
+
+      bytes += entries[t].size;
+
+      free(data);
+      free(tile);
+    }
+
+  free(tiles);
+  free(entries);
+
+  return err ? -1 : bytes;
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *fp;
+  snapheader h;
+  int **cell;
+  long k, frame;
+  long long bytes;
+
+  if (argc != 2 && argc != 4)
+    {
+      printf("Usage: snapdecode <file> [<frame> <pbmfile>]\n");
+      return 1;
+    }
+
+  fp = fopen(argv[1], "rb");
+
+  if (fp == NULL || fread(&h, sizeof(h), 1, fp) != 1 ||
+      memcmp(h.magic, SNAPMAGIC, sizeof(h.magic)) != 0 ||
+      h.version != SNAPVERSION)
+    {
+      printf("snapdecode: <%s> is not a complete snapshot file\n", argv[1]);
+      return 1;
+    }
+
+  printf("snapdecode: L = %d, %s frames, %lld frames every %d steps from step %lld\n",
+         h.l, h.format == SNAP_RLE ? "compressed" : "raw",
+         (long long) h.nframes, h.freq, (long long) h.first);
+
+  cell = (int **) arraymalloc2d(h.l, h.l, sizeof(int));
+
+  if (argc == 2)
+    {
+      for (k=0; k < h.nframes; k++)
+        {
+          bytes = readframe(fp, &h, k, cell);
+
+          if (bytes < 0)
+            {
+              printf("snapdecode: cannot read frame %ld\n", k);
+              return 1;
+            }
+
+          printf("frame %ld: step %lld, %lld bytes (%.1f%%)\n",
+                 k, (long long) (h.first + k*h.freq), bytes,
+                 100.0*bytes/((double) h.l*h.l));
+        }
+    }
+  else
+    {
+      frame = atol(argv[2]);
+
+      if (frame < 0 || frame >= h.nframes || readframe(fp, &h, frame, cell) < 0)
+        {
+          printf("snapdecode: cannot read frame %ld\n", frame);
+          return 1;
+        }
+
+      autowritedynamic(argv[3], cell, h.l);
+    }
+
+  free(cell);
+  fclose(fp);
+
+  return 0;
+}
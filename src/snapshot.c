@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "rle.h"
+#include "snapshot.h"
+#include "largecount.h"
+
+/*
+ *  Open the snapshot file for a run starting at step0; the first frame
+ *  is the first step from step0 on that is a multiple of freq.
+ *  Collective. Returns NULL if the file cannot be opened.
+ */
+
+snapshot *snapcreate(const char *name, int format, int freq, long step0,
+                     grid *g, MPI_Comm comm)
+{
+  snapshot *s;
+  MPI_Datatype filetype;
+  snaptile tile, *tiles;
+  size_t bufsize;
+  int k, rank, size;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  s = (snapshot *) calloc(1, sizeof(snapshot));
+
+  if (MPI_File_open(comm, name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &s->fh) != MPI_SUCCESS)
+    {
+      free(s);
+      return NULL;
+    }
+
+  MPI_File_set_size(s->fh, 0);
+
+  s->comm = comm;
+  s->freq = freq;
+  s->lx = g->lx;
+  s->ly = g->ly;
+
+  memcpy(s->header.magic, SNAPMAGIC, sizeof(s->header.magic));
+  s->header.version = SNAPVERSION;
+  s->header.l = L;
+  s->header.first = ((step0 + freq - 1) / freq) * freq;
+  s->header.freq = freq;
+  s->header.rule = RULE;
+  s->header.format = format;
+
+  bufsize = (size_t) g->lx*g->ly;
+
+  if (format == SNAP_RLE)
+    {
+      bufsize = RLEBOUND(bufsize);
+
+      s->tile = (unsigned char *) malloc((size_t) g->lx*g->ly);
+      s->sizes = (long *) malloc(size*sizeof(long));
+      s->header.ntiles = size;
+
+      /*
+       *  Rank 0 writes where every tile is straight after the header
+       */
+
+      tile.x0 = g->x0;
+      tile.y0 = g->y0;
+      tile.lx = g->lx;
+      tile.ly = g->ly;
+
+      tiles = (snaptile *) malloc(size*sizeof(snaptile));
+
+      MPI_Gather(&tile, sizeof(snaptile), MPI_BYTE,
+                 tiles, sizeof(snaptile), MPI_BYTE, 0, comm);
+
+      if (rank == 0)
+        {
+          MPI_File_write_at(s->fh, SNAPHEADER, tiles, size*sizeof(snaptile),
+                            MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+
+      free(tiles);
+
+      s->end = SNAPHEADER + (MPI_Offset) size*sizeof(snaptile);
+    }
+
+  for (k=0; k < SNAPBUFFERS; k++)
+    {
+      s->buf[k] = (unsigned char *) malloc(bufsize);
+      s->request[k] = MPI_REQUEST_NULL;
+    }
+
+  /*
+   *  The subarray of the global grid has the extent of a whole frame,
+   *  so the view tiles the frames one after another and frame k is at
+   *  offset k*lx*ly in the view of every process
+   */
+
+  if (format == SNAP_RAW)
+    {
+      filetype = gridfiletype(g, MPI_UNSIGNED_CHAR);
+      MPI_File_set_view(s->fh, SNAPHEADER, MPI_UNSIGNED_CHAR, filetype,
+                        "native", MPI_INFO_NULL);
+      MPI_Type_free(&filetype);
+    }
+
+  return s;
+}
+
+/*
+ *  Compress the local tile into buf and start writing it after the
+ *  tiles of the lower ranks. Collective.
+ */
+
+static void snaprle(snapshot *s, grid *g, unsigned char *buf,
+                    MPI_Request *request)
+{
+  MPI_Offset offset;
+  MPI_Datatype big;
+  long size;
+  int k, rank, ntiles, count;
+  snapentry *e;
+
+  MPI_Comm_rank(s->comm, &rank);
+  ntiles = s->header.ntiles;
+
+  gridgetbytes(g, s->tile);
+  size = rleencode(s->tile, (long) s->lx*s->ly, buf);
+
+  // every process needs the offsets of the lower ranks, rank 0 all of them
+
+  MPI_Allgather(&size, 1, MPI_LONG, s->sizes, 1, MPI_LONG, s->comm);
+
+  if (rank == 0 && s->nframes == s->nindex)
+    {
+      s->nindex = (s->nindex == 0) ? 64 : 2*s->nindex;
+      s->index = (snapentry *) realloc(s->index,
+                                       s->nindex*ntiles*sizeof(snapentry));
+    }
+
+  offset = s->end;
+
+  for (k=0; k < rank; k++)
+    {
+      offset += s->sizes[k];
+    }
+
+  for (k=0; k < ntiles; k++)
+    {
+      if (rank == 0)
+        {
+          e = &s->index[s->nframes*ntiles + k];
+          e->offset = s->end;
+          e->size = s->sizes[k];
+        }
+      s->end += s->sizes[k];
+      s->bytes += s->sizes[k];
+    }
+
+  count = largetype(size, MPI_BYTE, &big);
+  MPI_File_iwrite_at_all(s->fh, offset, buf, count, big, request);
+  largefree(&big, MPI_BYTE);
+}
+
+/*
+ *  Take a frame if step is on the cadence. Only the copy of the local
+ *  tile (and its compression) is done here unless all the buffers are
+ *  still being written. Collective.
+ */
+
+void snapstep(snapshot *s, grid *g, long step)
+{
+  MPI_Datatype big;
+  double t0, t1, t2;
+  int k, count, done;
+
+  if (step % s->freq != 0 || step < s->header.first) return;
+
+  k = s->nframes % SNAPBUFFERS;
+
+  // only a write still in flight holds us up
+
+  MPI_Test(&s->request[k], &done, MPI_STATUS_IGNORE);
+
+  t0 = MPI_Wtime();
+
+  if (!done)
+    {
+      s->nwait++;
+      MPI_Wait(&s->request[k], MPI_STATUS_IGNORE);
+    }
+
+  t1 = MPI_Wtime();
+
+  if (s->header.format == SNAP_RLE)
+    {
+      snaprle(s, g, s->buf[k], &s->request[k]);
+    }
+  else
+    {
+      gridgetbytes(g, s->buf[k]);
+
+      count = largetype((long) s->lx*s->ly, MPI_UNSIGNED_CHAR, &big);
+      MPI_File_iwrite_at_all(s->fh, (MPI_Offset) s->nframes*s->lx*s->ly,
+                             s->buf[k], count, big, &s->request[k]);
+      largefree(&big, MPI_UNSIGNED_CHAR);
+    }
+
+  t2 = MPI_Wtime();
+
+  s->twait += t1 - t0;
+  s->tcopy += t2 - t1;
+  s->nframes++;
+}
+
+/*
+ *  Drain the outstanding frames, then write the index and the header.
+ *  Collective.
+ */
+
+void snapfree(snapshot *s)
+{
+  int k, rank;
+
+  MPI_Comm_rank(s->comm, &rank);
+
+  MPI_Waitall(SNAPBUFFERS, s->request, MPI_STATUSES_IGNORE);
+
+  s->header.nframes = s->nframes;
+
+  MPI_File_set_view(s->fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+
+  if (rank == 0)
+    {
+      if (s->header.format == SNAP_RLE)
+        {
+          s->header.index = s->end;
+
+          MPI_File_write_at(s->fh, s->end, s->index,
+                            s->nframes*s->header.ntiles*sizeof(snapentry),
+                            MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+
+      MPI_File_write_at(s->fh, 0, &s->header, sizeof(snapheader),
+                        MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+  MPI_File_close(&s->fh);
+
+  for (k=0; k < SNAPBUFFERS; k++)
+    {
+      free(s->buf[k]);
+    }
+
+  free(s->tile);
+  free(s->sizes);
+  free(s->index);
+  free(s);
+}
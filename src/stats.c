@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "stats.h"
+#include "largecount.h"
+
+/*
+ *  Start collecting statistics from step0 on. The time series file is
+ *  opened on rank 0; returns NULL on every process if it cannot be.
+ *  Collective.
+ */
+
+stats *statscreate(const char *name, int freq, long step0, grid *g,
+                   MPI_Comm comm, int rank)
+{
+  stats *s;
+  statsheader h;
+  int ok;
+
+  s = (stats *) calloc(1, sizeof(stats));
+
+  s->name = name;
+  s->freq = freq;
+  s->first = step0 + 1;
+  s->last = step0;
+
+  ok = 1;
+
+  if (rank == 0)
+    {
+      s->fp = fopen(name, "wb");
+
+      if (s->fp != NULL)
+        {
+          memset(&h, 0, sizeof(h));
+          memcpy(h.magic, STATSMAGIC, sizeof(h.magic));
+          h.version = STATSVERSION;
+          h.l = L;
+          h.first = s->first;
+
+          fwrite(&h, sizeof(h), 1, s->fp);
+          fseek(s->fp, STATSHEADER, SEEK_SET);
+        }
+    }
+
+  if (rank == 0 && s->fp == NULL) ok = 0;
+
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+
+  if (!ok)
+    {
+      free(s);
+      return NULL;
+    }
+
+  s->step = (long *) malloc(freq*sizeof(long));
+  s->ncell = (long *) malloc(freq*sizeof(long));
+  s->nflip = (long *) malloc(freq*sizeof(long));
+  s->allflip = (long *) malloc(freq*sizeof(long));
+  s->record = (statsrecord *) malloc(freq*sizeof(statsrecord));
+
+  gridflips(g);
+
+  return s;
+}
+
+/*
+ *  Reduce the buffered flip counts and append them to the series
+ */
+
+static void statsflush(stats *s, MPI_Comm comm, int rank)
+{
+  int k;
+
+  if (s->n == 0) return;
+
+  MPI_Reduce(s->nflip, s->allflip, s->n, MPI_LONG, MPI_SUM, 0, comm);
+
+  if (rank == 0)
+    {
+      for (k=0; k < s->n; k++)
+        {
+          s->record[k].step = s->step[k];
+          s->record[k].ncell = s->ncell[k];
+          s->record[k].nflip = s->allflip[k];
+          s->record[k].density = (double) s->ncell[k] / ((double) L*L);
+        }
+
+      fwrite(s->record, sizeof(statsrecord), s->n, s->fp);
+    }
+
+  s->n = 0;
+}
+
+/*
+ *  Record the step just taken, with ncell living cells in total.
+ *  Collective every freq steps.
+ */
+
+void statsstep(stats *s, grid *g, long step, long ncell, MPI_Comm comm,
+               int rank)
+{
+  s->step[s->n] = step;
+  s->ncell[s->n] = ncell;
+  s->nflip[s->n] = g->nflip;
+  s->n++;
+  s->last = step;
+
+  if (s->n == s->freq) statsflush(s, comm, rank);
+}
+
+/*
+ *  Flush the series and write the heatmap. Collective.
+ */
+
+void statsfree(stats *s, grid *g, MPI_Comm comm, int rank)
+{
+  char filename[1024];
+  statsheader h;
+  MPI_File fh;
+  MPI_Datatype filetype, big;
+  int count;
+
+  statsflush(s, comm, rank);
+
+  if (rank == 0) fclose(s->fp);
+
+  snprintf(filename, sizeof(filename), "%s.heat", s->name);
+
+  if (MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &fh) == MPI_SUCCESS)
+    {
+      MPI_File_set_size(fh, STATSHEADER + (MPI_Offset) L*L*sizeof(uint32_t));
+
+      if (rank == 0)
+        {
+          memset(&h, 0, sizeof(h));
+          memcpy(h.magic, HEATMAGIC, sizeof(h.magic));
+          h.version = STATSVERSION;
+          h.l = L;
+          h.first = s->first;
+          h.last = s->last;
+
+          MPI_File_write_at(fh, 0, &h, sizeof(h), MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+
+      filetype = gridfiletype(g, MPI_UNSIGNED);
+      MPI_File_set_view(fh, STATSHEADER, MPI_UNSIGNED, filetype,
+                        "native", MPI_INFO_NULL);
+      MPI_Type_free(&filetype);
+
+      count = largetype((long) g->lx*g->ly, MPI_UNSIGNED, &big);
+      MPI_File_write_all(fh, g->flips, count, big, MPI_STATUS_IGNORE);
+      largefree(&big, MPI_UNSIGNED);
+
+      MPI_File_close(&fh);
+    }
+  else if (rank == 0)
+    {
+      printf("stats: cannot open <%s>\n", filename);
+    }
+
+  free(s->step);
+  free(s->ncell);
+  free(s->nflip);
+  free(s->allflip);
+  free(s->record);
+  free(s);
+}
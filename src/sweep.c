@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "grid.h"
+#include "rng.h"
+#include "sweep.h"
+
+/*
+ *  Draw the numbers of the local tile, the same ones the automaton
+ *  compares with rho: with RNG_COUNTER every process draws its own,
+ *  with RNG_UNI rank 0 draws the rows in order and broadcasts them one
+ *  at a time. Collective.
+ */
+
+sweep *sweepcreate(grid *g, int mode, int seed, int maxstep, MPI_Comm comm)
+{
+  sweep *w;
+  rng gen, rowgen;
+  float *all;
+  int rank, i;
+
+  MPI_Comm_rank(comm, &rank);
+
+  w = (sweep *) calloc(1, sizeof(sweep));
+
+  w->u = (float *) malloc((size_t) g->lx*g->ly*sizeof(float));
+  w->row = (int *) malloc(g->ly*sizeof(int));
+  w->maxstep = maxstep;
+
+  rngseed(&gen, mode, seed);
+
+  if (mode == RNG_COUNTER)
+    {
+      for (i=1; i <= g->lx; i++)
+        {
+          rowgen = gen;
+
+          rngjump(&rowgen, (uint64_t) (g->x0+i-1)*L + g->y0);
+          rngfill(&rowgen, w->u + (size_t) (i-1)*g->ly, g->ly);
+        }
+
+      return w;
+    }
+
+  all = (float *) malloc(L*sizeof(float));
+
+  for (i=0; i < L; i++)
+    {
+      if (rank == 0) rngfill(&gen, all, L);
+
+      MPI_Bcast(all, L, MPI_FLOAT, 0, comm);
+
+      if (i >= g->x0 && i < g->x0 + g->lx)
+        {
+          memcpy(w->u + (size_t) (i-g->x0)*g->ly, all + g->y0,
+                 g->ly*sizeof(float));
+        }
+    }
+
+  free(all);
+
+  return w;
+}
+
+void sweepfree(sweep *w)
+{
+  free(w->u);
+  free(w->row);
+  free(w);
+}
+
+/*
+ *  Set the cells below rho alive, one pass over the numbers, and run
+ *  the automaton. Returns the step on which it terminates, or 0 if it
+ *  reaches maxstep; *incells is the initial number of living cells.
+ *  Collective.
+ */
+
+int sweeprun(sweep *w, grid *g, double rho, long *incells, MPI_Comm comm,
+             int up, int down, int left, int right)
+{
+  const float *u;
+  long localncell, ncell;
+  int i, j, step;
+
+  localncell = 0;
+
+  for (i=1; i <= g->lx; i++)
+    {
+      u = w->u + (size_t) (i-1)*g->ly;
+
+      for (j=0; j < g->ly; j++)
+        {
+          w->row[j] = (u[j] < rho);
+          localncell += w->row[j];
+        }
+
+      gridsetrow(g, i, w->row);
+    }
+
+  gridboundary(g);
+
+  MPI_Allreduce(&localncell, incells, 1, MPI_LONG, MPI_SUM, comm);
+
+  for (step=1; step <= w->maxstep; step++)
+    {
+      gridhalo(g, comm, up, down, left, right);
+
+      localncell = gridstep(g);
+
+      MPI_Allreduce(&localncell, &ncell, 1, MPI_LONG, MPI_SUM, comm);
+
+      if (ncell < (3*(*incells))/4 || ncell > (4*(*incells))/3) return step;
+    }
+
+  return 0;
+}
+
+/*
+ *  Run both ends of lo ... hi and, if one terminates and the other
+ *  does not, halve the range n times keeping the ends on either side
+ *  of the change. Progress is printed on rank 0. Collective.
+ */
+
+void sweepbisect(sweep *w, grid *g, double lo, double hi, int n,
+                 MPI_Comm comm, int up, int down, int left, int right)
+{
+  double rho, t;
+  long incells;
+  int k, rank, stop, stoplo = 0, stophi = 0;
+
+  MPI_Comm_rank(comm, &rank);
+
+  for (k=-2; k < n; k++)
+    {
+      rho = (k == -2) ? lo : (k == -1) ? hi : 0.5*(lo + hi);
+
+      t = MPI_Wtime();
+      stop = sweeprun(w, g, rho, &incells, comm, up, down, left, right);
+      t = MPI_Wtime() - t;
+
+      if (rank == 0)
+        {
+          if (stop > 0)
+            printf("sweep: rho = %f, %ld living cells, terminates at step %d (%f s)\n",
+                   rho, incells, stop, t);
+          else
+            printf("sweep: rho = %f, %ld living cells, runs %d steps (%f s)\n",
+                   rho, incells, w->maxstep, t);
+        }
+
+      if (k == -2)
+        {
+          stoplo = (stop > 0);
+        }
+      else if (k == -1)
+        {
+          stophi = (stop > 0);
+
+          if (stoplo == stophi)
+            {
+              if (rank == 0)
+                {
+                  printf("sweep: same outcome at rho = %f and %f, nothing to bisect\n",
+                         lo, hi);
+                }
+              return;
+            }
+        }
+      else if ((stop > 0) == stoplo)
+        {
+          lo = rho;
+        }
+      else
+        {
+          hi = rho;
+        }
+    }
+
+  if (rank == 0)
+    {
+      printf("sweep: the outcome changes between rho = %f and %f\n", lo, hi);
+    }
+}
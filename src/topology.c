@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "topology.h"
+
+/*
+ *  Node of every rank of comm, numbered in order of their lowest rank.
+ *  Returns the number of nodes.
+ */
+
+static int findnodes(int nodesize, MPI_Comm comm, int *node)
+{
+  MPI_Comm nodecomm;
+  int rank, size, r, leader, nnodes;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  if (nodesize > 0)
+    {
+      for (r=0; r < size; r++)
+        {
+          node[r] = r/nodesize;
+        }
+
+      return (size + nodesize - 1)/nodesize;
+    }
+
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                      &nodecomm);
+
+  leader = rank;
+  MPI_Allreduce(MPI_IN_PLACE, &leader, 1, MPI_INT, MPI_MIN, nodecomm);
+  MPI_Comm_free(&nodecomm);
+
+  MPI_Allgather(&leader, 1, MPI_INT, node, 1, MPI_INT, comm);
+
+  // a leader comes before the other ranks of its node
+
+  nnodes = 0;
+
+  for (r=0; r < size; r++)
+    {
+      node[r] = (node[r] == r) ? nnodes++ : node[node[r]];
+    }
+
+  return nnodes;
+}
+
+/*
+ *  Segment lengths of setXY for l split n ways
+ */
+
+static void segments(int l, int n, int *len)
+{
+  int k;
+
+  for (k=0; k < n-1; k++)
+    {
+      len[k] = l/n;
+    }
+
+  len[n-1] = l - (n-1)*(l/n);
+}
+
+static int linkclass(const int *node, int a, int b)
+{
+  if (a == b) return TOPO_SELF;
+
+  return (node[a] == node[b]) ? TOPO_NODE : TOPO_NETWORK;
+}
+
+/*
+ *  Halo bytes sent per step in each class, as gridhalo sends them for
+ *  an l x l automaton, when rank at[i*py + j] is at position (i, j) of
+ *  the px x py grid
+ */
+
+static void predict(int l, const int *dims, const int *at, const int *node,
+                    long *bytes)
+{
+  int px = dims[0], py = dims[1];
+  int *lx, *ly;
+  int i, j, a;
+
+  lx = (int *) malloc(px*sizeof(int));
+  ly = (int *) malloc(py*sizeof(int));
+
+  segments(l, px, lx);
+  segments(l, py, ly);
+
+  memset(bytes, 0, TOPO_CLASSES*sizeof(long));
+
+  for (i=0; i < px; i++)
+    {
+      for (j=0; j < py; j++)
+        {
+          a = at[i*py + j];
+
+          // periodic up and down, fixed left and right
+
+          bytes[linkclass(node, a, at[((i+px-1)%px)*py + j])] += ly[j]*sizeof(int);
+          bytes[linkclass(node, a, at[((i+1)%px)*py + j])] += ly[j]*sizeof(int);
+
+          if (j > 0)    bytes[linkclass(node, a, at[i*py + j-1])] += lx[i]*sizeof(int);
+          if (j < py-1) bytes[linkclass(node, a, at[i*py + j+1])] += lx[i]*sizeof(int);
+        }
+    }
+
+  free(lx);
+  free(ly);
+}
+
+/*
+ *  Fewer bytes between nodes, then within nodes, then to self
+ */
+
+static int better(const long *a, const long *b)
+{
+  int k;
+
+  for (k=TOPO_CLASSES-1; k >= 0; k--)
+    {
+      if (a[k] != b[k]) return (a[k] < b[k]);
+    }
+
+  return 0;
+}
+
+/*
+ *  Place the q ranks of node k, order[k*q] ... order[k*q + q-1], on
+ *  block k of nx x ny positions of the grid, blocks in row-major order
+ */
+
+static void place(const int *dims, int nx, int ny, int q, const int *order,
+                  int *at)
+{
+  int i, j, k, m;
+
+  for (i=0; i < dims[0]; i++)
+    {
+      for (j=0; j < dims[1]; j++)
+        {
+          k = (i/nx)*(dims[1]/ny) + j/ny;
+          m = (i%nx)*ny + j%ny;
+
+          at[i*dims[1] + j] = order[k*q + m];
+        }
+    }
+}
+
+/*
+ *  Plan the process grid for an l x l automaton and return in newcomm
+ *  a copy of comm whose rank r is at position r of the grid in
+ *  row-major order, as MPI_Cart_create expects with reorder = 0.
+ *  Collective.
+ */
+
+topology *topocreate(int mode, int nodesize, int l, MPI_Comm comm,
+                     MPI_Comm *newcomm)
+{
+  topology *t;
+  int *node, *count, *order, *at, *best;
+  int rank, size, r, k, q, px, nx, dims[2];
+  long bytes[TOPO_CLASSES];
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  t = (topology *) calloc(1, sizeof(topology));
+
+  t->size = size;
+  node = (int *) malloc(size*sizeof(int));
+  t->nnodes = findnodes(nodesize, comm, node);
+
+  /*
+   *  Ranks in order of node, and the number per node if it is even
+   */
+
+  count = (int *) calloc(t->nnodes + 1, sizeof(int));
+  order = (int *) malloc(size*sizeof(int));
+
+  for (r=0; r < size; r++)
+    {
+      count[node[r]+1]++;
+    }
+
+  t->nodesize = (size % t->nnodes == 0) ? size/t->nnodes : 0;
+
+  for (k=0; k < t->nnodes; k++)
+    {
+      if (count[k+1] != t->nodesize) t->nodesize = 0;
+      count[k+1] += count[k];
+    }
+
+  for (r=0; r < size; r++)
+    {
+      order[count[node[r]]++] = r;
+    }
+
+  /*
+   *  Start from MPI_Dims_create in row-major order
+   */
+
+  at = (int *) malloc(size*sizeof(int));
+  best = (int *) malloc(size*sizeof(int));
+
+  for (r=0; r < size; r++)
+    {
+      best[r] = r;
+    }
+
+  MPI_Dims_create(size, 2, t->dims);
+  predict(l, t->dims, best, node, t->predicted);
+
+  q = t->nodesize;
+
+  for (px=1; mode == TOPO_PLAN && px <= size; px++)
+    {
+      if (size % px != 0) continue;
+
+      dims[0] = px;
+      dims[1] = size/px;
+
+      for (nx=0; nx <= q; nx++)
+        {
+          if (nx == 0)
+            {
+              for (r=0; r < size; r++) at[r] = r;
+            }
+          else if (q % nx == 0 && px % nx == 0 && dims[1] % (q/nx) == 0)
+            {
+              place(dims, nx, q/nx, q, order, at);
+            }
+          else
+            {
+              continue;
+            }
+
+          predict(l, dims, at, node, bytes);
+
+          if (better(bytes, t->predicted))
+            {
+              memcpy(t->dims, dims, sizeof(dims));
+              memcpy(t->predicted, bytes, sizeof(bytes));
+              memcpy(best, at, size*sizeof(int));
+              t->nodedims[0] = nx;
+              t->nodedims[1] = (nx == 0) ? 0 : q/nx;
+            }
+        }
+    }
+
+  /*
+   *  The rank placed at position k becomes rank k
+   */
+
+  for (k=0; k < size; k++)
+    {
+      if (best[k] == rank) break;
+    }
+
+  MPI_Comm_split(comm, 0, k, newcomm);
+
+  t->node = (int *) malloc(size*sizeof(int));
+
+  for (k=0; k < size; k++)
+    {
+      t->node[k] = node[best[k]];
+    }
+
+  free(node);
+  free(count);
+  free(order);
+  free(at);
+  free(best);
+
+  return t;
+}
+
+/*
+ *  Predict the halo bytes of the chosen placement again, for an l x l
+ *  automaton
+ */
+
+void topopredict(topology *t, int l)
+{
+  int *at;
+  int k;
+
+  at = (int *) malloc(t->size*sizeof(int));
+
+  for (k=0; k < t->size; k++)
+    {
+      at[k] = k;
+    }
+
+  predict(l, t->dims, at, t->node, t->predicted);
+
+  free(at);
+}
+
+/*
+ *  Class of the link from rank to other in the reordered communicator,
+ *  or -1 if other is MPI_PROC_NULL
+ */
+
+int topoclass(topology *t, int rank, int other)
+{
+  if (other == MPI_PROC_NULL) return -1;
+
+  return linkclass(t->node, rank, other);
+}
+
+void topofree(topology *t)
+{
+  free(t->node);
+  free(t);
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "grid.h"
+#include "checksum.h"
+#include "verify.h"
+
+/*
+ *  Each trace line is "step ncell checksum" with the checksum in hex
+ */
+
+verify *verifycreate(int freq, const char *tracefile, const char *goldenfile,
+                     int rank)
+{
+  verify *v;
+
+  v = (verify *) calloc(1, sizeof(verify));
+
+  v->freq = freq;
+  v->compare = (goldenfile != NULL);
+  v->firstbad = -1;
+  v->firstmissing = -1;
+
+  if (rank == 0)
+    {
+      v->trace = fopen(tracefile, "w");
+
+      if (v->trace == NULL)
+        {
+          printf("verify: cannot open trace file <%s>\n", tracefile);
+        }
+      else
+        {
+          fprintf(v->trace, "# step ncell checksum\n");
+        }
+
+      if (goldenfile != NULL)
+        {
+          v->golden = fopen(goldenfile, "r");
+
+          if (v->golden == NULL)
+            {
+              printf("verify: cannot open golden trace <%s>\n", goldenfile);
+            }
+        }
+    }
+
+  return v;
+}
+
+/*
+ *  A step found in only one of the traces
+ */
+
+static void missing(verify *v, long step, const char *trace)
+{
+  if (v->nmissing == 0)
+    {
+      printf("verify: step %ld is only in the %s trace\n", step, trace);
+      v->firstmissing = step;
+    }
+  v->nmissing++;
+}
+
+/*
+ *  Read golden records until one for "step" is found. Returns 1 and
+ *  sets *ncell and *sum if there is one, 0 if the golden trace skips
+ *  this step. Golden steps passed over are missing from the run,
+ *  except before the first step checked (a restarted run).
+ */
+
+static int goldenrecord(verify *v, long step, long *ncell, checksum *sum)
+{
+  char line[256];
+  long gstep;
+  long pos;
+
+  while (1)
+    {
+      pos = ftell(v->golden);
+
+      if (fgets(line, sizeof(line), v->golden) == NULL) return 0;
+      if (line[0] == '#') continue;
+
+      if (sscanf(line, "%ld %ld %llx", &gstep, ncell, sum) != 3) continue;
+
+      if (gstep == step) return 1;
+
+      if (gstep > step)
+        {
+          fseek(v->golden, pos, SEEK_SET); // leave it for a later step
+          return 0;
+        }
+
+      if (v->nchecked > 0 || v->nmissing > 0) missing(v, gstep, "golden");
+    }
+}
+
+/*
+ *  Called on every step, and on step 0 after initialisation; does
+ *  nothing unless step is a multiple of freq
+ */
+
+void verifystep(verify *v, grid *g, long step, long ncell, MPI_Comm comm,
+                int rank)
+{
+  checksum local, sum, gsum;
+  long gncell;
+
+  if (step % v->freq != 0) return;
+
+  local = gridchecksum(g);
+
+  MPI_Reduce(&local, &sum, 1, MPI_CHECKSUM, MPI_SUM, 0, comm);
+
+  if (rank != 0) return;
+
+  if (v->trace != NULL)
+    {
+      fprintf(v->trace, "%ld %ld %016llx\n", step, ncell, sum);
+    }
+
+  if (v->golden == NULL) return;
+
+  if (!goldenrecord(v, step, &gncell, &gsum))
+    {
+      missing(v, step, "run's");
+      return;
+    }
+
+  v->nchecked++;
+
+  if (sum != gsum || ncell != gncell)
+    {
+      if (v->nbad == 0)
+        {
+          printf("verify: step %ld differs from golden trace "
+                 "(%ld cells %016llx, golden %ld cells %016llx)\n",
+                 step, ncell, sum, gncell, gsum);
+          v->firstbad = step;
+        }
+      v->nbad++;
+    }
+}
+
+/*
+ *  Close the files and report. Returns the number of differences and
+ *  missing steps, at least 1 if a golden trace gave nothing to compare.
+ */
+
+int verifyfree(verify *v, int rank)
+{
+  char line[256];
+  long gstep, gncell;
+  checksum gsum;
+  int nbad = 0;
+
+  if (rank == 0)
+    {
+      if (v->trace != NULL) fclose(v->trace);
+
+      // golden steps after the last one of the run
+
+      while (v->golden != NULL && fgets(line, sizeof(line), v->golden) != NULL)
+        {
+          if (line[0] != '#' &&
+              sscanf(line, "%ld %ld %llx", &gstep, &gncell, &gsum) == 3)
+            {
+              missing(v, gstep, "golden");
+            }
+        }
+
+      if (v->compare)
+        {
+          if (v->nchecked == 0)
+            {
+              printf("verify: no checksums compared with the golden trace\n");
+            }
+          else if (v->nbad == 0 && v->nmissing == 0)
+            {
+              printf("verify: %ld checksums match the golden trace\n",
+                     v->nchecked);
+            }
+          else
+            {
+              if (v->nbad > 0)
+                printf("verify: %ld of %ld checksums differ, first at step %ld\n",
+                       v->nbad, v->nchecked, v->firstbad);
+
+              if (v->nmissing > 0)
+                printf("verify: %ld steps in only one of the traces, first %ld\n",
+                       v->nmissing, v->firstmissing);
+            }
+
+          nbad = v->nbad + v->nmissing + (v->nchecked == 0);
+        }
+
+      if (v->golden != NULL) fclose(v->golden);
+    }
+
+  free(v);
+
+  return nbad;
+}
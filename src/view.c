@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "automaton.h"
+#include "arraymalloc.h"
+#include "grid.h"
+#include "view.h"
+
+#define VIEWTAG 3
+
+/*
+ *  Read a window "x,y,nx,ny" (origin and size in cells) into window.
+ *  Returns 0 if it lies within the grid and 1 otherwise.
+ */
+
+int viewparse(const char *s, int *window)
+{
+  char c;
+
+  if (sscanf(s, "%d,%d,%d,%d%c", &window[0], &window[1], &window[2],
+             &window[3], &c) != 4)
+    {
+      return 1;
+    }
+
+  return (window[0] < 0 || window[1] < 0 || window[2] < 1 || window[3] < 1 ||
+          window[0] + window[2] > L || window[1] + window[3] > L);
+}
+
+/*
+ *  Position and size of the tile of every process, on rank 0
+ */
+
+static int *gathertiles(grid *g, MPI_Comm comm)
+{
+  int tile[4], *tiles;
+  int rank, size;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  tile[0] = g->x0;
+  tile[1] = g->y0;
+  tile[2] = g->lx;
+  tile[3] = g->ly;
+
+  tiles = (rank == 0) ? (int *) malloc(4*size*sizeof(int)) : NULL;
+
+  MPI_Gather(tile, 4, MPI_INT, tiles, 4, MPI_INT, 0, comm);
+
+  return tiles;
+}
+
+/*
+ *  Overlap of [a0, a0+na) with [b0, b0+nb) as a start and a length,
+ *  which is zero or negative if they do not overlap
+ */
+
+static int overlap(int a0, int na, int b0, int nb, int *n)
+{
+  int lo = (a0 > b0) ? a0 : b0;
+  int hi = (a0+na < b0+nb) ? a0+na : b0+nb;
+
+  *n = hi - lo;
+
+  return lo;
+}
+
+/*
+ *  Write the cells of window (x, y, nx, ny) to file from rank 0. Only
+ *  the processes whose tile overlaps the window send anything, and
+ *  rank 0 only stores the window. Collective.
+ */
+
+void viewwindow(grid *g, const int *window, char *file, MPI_Comm comm)
+{
+  int **cell, *row, *buf, *tiles;
+  int sizes[2], subsizes[2], starts[2];
+  int rank, size, r, ox, oy, nx, ny, i, j, nreq;
+  MPI_Request *request;
+  MPI_Datatype *block;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  tiles = gathertiles(g, comm);
+
+  /*
+   *  Send the part of the window in this tile, if any
+   */
+
+  buf = NULL;
+  ox = overlap(window[0], window[2], g->x0, g->lx, &nx);
+  oy = overlap(window[1], window[3], g->y0, g->ly, &ny);
+
+  if (nx > 0 && ny > 0 && rank != 0)
+    {
+      buf = (int *) malloc(nx*ny*sizeof(int));
+      row = (int *) malloc(g->ly*sizeof(int));
+
+      for (i=0; i < nx; i++)
+        {
+          gridgetrow(g, ox - g->x0 + i + 1, row);
+
+          for (j=0; j < ny; j++)
+            {
+              buf[i*ny + j] = row[oy - g->y0 + j];
+            }
+        }
+
+      MPI_Send(buf, nx*ny, MPI_INT, 0, VIEWTAG, comm);
+
+      free(row);
+      free(buf);
+    }
+
+  if (rank != 0) return;
+
+  /*
+   *  Receive each overlapping tile straight into its place in the
+   *  window, and copy our own part
+   */
+
+  cell = (int **) arraymalloc2d(window[2], window[3], sizeof(int));
+  request = (MPI_Request *) malloc(size*sizeof(MPI_Request));
+  block = (MPI_Datatype *) malloc(size*sizeof(MPI_Datatype));
+  nreq = 0;
+
+  sizes[0] = window[2];
+  sizes[1] = window[3];
+
+  for (r=1; r < size; r++)
+    {
+      ox = overlap(window[0], window[2], tiles[4*r], tiles[4*r+2], &nx);
+      oy = overlap(window[1], window[3], tiles[4*r+1], tiles[4*r+3], &ny);
+
+      if (nx <= 0 || ny <= 0) continue;
+
+      subsizes[0] = nx;
+      subsizes[1] = ny;
+      starts[0] = ox - window[0];
+      starts[1] = oy - window[1];
+
+      MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+                               MPI_INT, &block[nreq]);
+      MPI_Type_commit(&block[nreq]);
+
+      MPI_Irecv(&cell[0][0], 1, block[nreq], r, VIEWTAG, comm, &request[nreq]);
+      nreq++;
+    }
+
+  ox = overlap(window[0], window[2], g->x0, g->lx, &nx);
+  oy = overlap(window[1], window[3], g->y0, g->ly, &ny);
+
+  if (nx > 0 && ny > 0)
+    {
+      row = (int *) malloc(g->ly*sizeof(int));
+
+      for (i=0; i < nx; i++)
+        {
+          gridgetrow(g, ox - g->x0 + i + 1, row);
+
+          for (j=0; j < ny; j++)
+            {
+              cell[ox - window[0] + i][oy - window[1] + j] = row[oy - g->y0 + j];
+            }
+        }
+
+      free(row);
+    }
+
+  MPI_Waitall(nreq, request, MPI_STATUSES_IGNORE);
+
+  for (r=0; r < nreq; r++)
+    {
+      MPI_Type_free(&block[r]);
+    }
+
+  autowriterect(file, cell, window[2], window[3]);
+
+  free(cell);
+  free(request);
+  free(block);
+  free(tiles);
+}
+
+/*
+ *  Range of k x k blocks [*c0, *c0 + n) covering [x0, x0+lx)
+ */
+
+static int blockrange(int x0, int lx, int k, int *c0)
+{
+  *c0 = x0/k;
+
+  return (x0 + lx - 1)/k - *c0 + 1;
+}
+
+/*
+ *  Write the density of living cells in k x k blocks as a greyscale
+ *  image from rank 0 (255 all alive, 0 all dead). Each process sums
+ *  the blocks its tile overlaps, and rank 0 adds up the partial sums
+ *  of blocks split between tiles. Collective.
+ */
+
+void viewcoarse(grid *g, int k, char *file, MPI_Comm comm)
+{
+  int **grey, *row, *sums, *allsums, *tiles, *counts, *displs;
+  int rank, size, r, n, nc, cx, cy, ncx, ncy, i, j, bx, by;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  tiles = gathertiles(g, comm);
+
+  ncx = blockrange(g->x0, g->lx, k, &cx);
+  ncy = blockrange(g->y0, g->ly, k, &cy);
+
+  sums = (int *) calloc(ncx*ncy, sizeof(int));
+  row = (int *) malloc(g->ly*sizeof(int));
+
+  for (i=0; i < g->lx; i++)
+    {
+      gridgetrow(g, i+1, row);
+
+      for (j=0; j < g->ly; j++)
+        {
+          sums[((g->x0+i)/k - cx)*ncy + (g->y0+j)/k - cy] += row[j];
+        }
+    }
+
+  free(row);
+
+  /*
+   *  Gather the partial sums of every tile
+   */
+
+  counts = NULL;
+  displs = NULL;
+  allsums = NULL;
+  n = ncx*ncy;
+
+  if (rank == 0)
+    {
+      counts = (int *) malloc(size*sizeof(int));
+      displs = (int *) malloc(size*sizeof(int));
+      n = 0;
+
+      for (r=0; r < size; r++)
+        {
+          counts[r] = blockrange(tiles[4*r], tiles[4*r+2], k, &cx) *
+                      blockrange(tiles[4*r+1], tiles[4*r+3], k, &cy);
+          displs[r] = n;
+          n += counts[r];
+        }
+
+      allsums = (int *) malloc(n*sizeof(int));
+      n = ncx*ncy;
+    }
+
+  MPI_Gatherv(sums, n, MPI_INT, allsums, counts, displs, MPI_INT, 0, comm);
+
+  free(sums);
+
+  if (rank != 0) return;
+
+  nc = (L + k - 1)/k;
+  grey = (int **) arraymalloc2d(nc, nc, sizeof(int));
+
+  for (i=0; i < nc; i++)
+    {
+      for (j=0; j < nc; j++)
+        {
+          grey[i][j] = 0;
+        }
+    }
+
+  for (r=0; r < size; r++)
+    {
+      ncx = blockrange(tiles[4*r], tiles[4*r+2], k, &cx);
+      ncy = blockrange(tiles[4*r+1], tiles[4*r+3], k, &cy);
+
+      for (i=0; i < ncx; i++)
+        {
+          for (j=0; j < ncy; j++)
+            {
+              grey[cx+i][cy+j] += allsums[displs[r] + i*ncy + j];
+            }
+        }
+    }
+
+  // the last blocks are smaller if k does not divide L
+
+  for (i=0; i < nc; i++)
+    {
+      bx = (L - i*k < k) ? L - i*k : k;
+
+      for (j=0; j < nc; j++)
+        {
+          by = (L - j*k < k) ? L - j*k : k;
+          grey[i][j] = (int) ((255L*grey[i][j] + bx*by/2) / (bx*by));
+        }
+    }
+
+  autowritepgm(file, grey, nc, nc);
+
+  free(grey);
+  free(allsums);
+  free(counts);
+  free(displs);
+  free(tiles);
+}